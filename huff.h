@@ -0,0 +1,468 @@
+/* huff.h
+ * 
+ * The huffman library, libhuff: frequency counting, tree and code
+ * construction, and block compression and decompression, shared by
+ * huffman.c, huffvis.c and huffsdl.c, or anything else that links with
+ * libhuff.a or libhuff.so.  Build with 'make libhuff.a libhuff.so'.
+ *
+ * hufftree.c  counts frequencies, builds the tree and its codes
+ * huffcodec.c encodes and decodes a single block
+ * hufffile.c  reads and writes whole compressed files and streams
+ * huffadapt.c one-pass adaptive coding, with no blocks or tables
+ * hufftable.c code tables trained once and shared by many inputs
+ * huffpair.c  blocks coded a byte pair at a time
+ * huffctx.c   blocks coded with tables picked by the char before
+ * huffseek.c  seek tables, to read a range without whole blocks
+ * huffpipe.c  the pipeline streams are read, coded and written through
+ * huffgrid.c  letter counts and tree layouts for huffvis.c and huffsdl.c
+ *
+ * Errors, such as corrupt input or a failed malloc, are reported on
+ * stderr and exit the program, unless the thread has called
+ * huff_catch_begin() (see hufffile.c), when they jump back to its
+ * setjmp() instead, with the message kept for the caller to report.
+ * Memory from libhuff must then be freed with freeMem().
+ */
+
+#ifndef HUFF_H
+#define HUFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <setjmp.h>
+
+#define ASIZE 256 /* size of arrays indexed by byte value */
+#define NOCHILD -1 /* child position of a leaf */
+#define BITSPERBYTE 8
+#define MAGIC "HUF" /* first bytes of a compressed file */
+#define MAGICLEN 3
+#define FORMATVERSION 3
+#define FILEHDRLEN 8 /* magic, version and block size */
+#define BLOCKHDRLEN 9 /* block type, raw length and length of the rest */
+#define LENGTHSLEN (HDRSYMS / 2) /* HDRSYMS length nibbles, 2 a byte */
+#define BLOCKHUFF 0 /* block types: huffman coded, */
+#define BLOCKHUFF4 1 /* huffman coded in NSTREAMS interleaved streams, */
+#define BLOCKPAIR 2 /* huffman coded a byte pair at a time, */
+#define BLOCKCTX 3 /* huffman coded by order-1 context, */
+#define BLOCKRAW 4 /* stored as it is, */
+#define BLOCKSEEK 0xFE /* the seek table, just before the end block, */
+#define BLOCKEND 0xFF /* or the end block holding the index */
+#define NSTREAMS 4
+#define STREAMSLEN (4 * (NSTREAMS - 1)) /* lengths of all but the last */
+#define INDEXENTRY 16 /* compressed and raw offset of each block */
+#define TRAILERLEN 16 /* total raw length and block count */
+#define SEEKENTRY 6 /* bit offset and char before of each seek point */
+#define BLOCKSIZE (1 << 20) /* default raw bytes per block */
+#define MINBLOCKSIZE 1024
+#define MAXBLOCKSIZE (1 << 28)
+#define MAXBLOCKS (1L << 27) /* keeps the index length in 4 bytes */
+#define HDRSYMS 256 /* blocks have a code length for every byte value */
+#define MAXCODELEN 15 /* longest code whose length fits in a nibble */
+#define TABLEBITS 12 /* most bits looked up at once by the decoder */
+#define SUBBITS (MAXCODELEN - TABLEBITS) /* most bits in a secondary table */
+#define DECODESIZE ((1 << TABLEBITS) + ASIZE * (1 << SUBBITS))
+#define ACCBITS 64 /* width of the bit accumulator */
+#define LENMASK 0x1F /* decode table entry: code length, */
+#define LINKFLAG 0x20 /* or set if it links to a secondary table */
+#define ENTRYSHIFT 8 /* followed by the char or secondary table offset */
+#define PAIRSYMS 65536 /* symbols of a pair block, one per byte pair */
+#define PAIRMAXCODELEN 20 /* longest code in a pair block */
+#define CTXTABLES 8 /* most code tables in a context block */
+#define MAXTHREADS 256
+#define CATCHFILES 2 /* most files a call can have open at once */
+#define CATCHMSGLEN 256 /* longest error message kept by a huffCatch */
+#define SAMPLECHUNK (1 << 16) /* bytes sampled at a time by sampleFreqs() */
+#define ADAPTVERSION 0x80 /* version byte of an adaptive file, */
+#define ADAPTHDRLEN 4     /* whose header is the magic and this byte */
+#define ADAPTSYMS 257 /* adaptive codes: every byte value, and */
+#define ADAPTEOF 256  /* the end of the data */
+#define ADAPTNODES (2 * ADAPTSYMS + 1) /* a leaf for each and NYT, and
+                                          their parents */
+#define LITERALBITS 9 /* bits of a symbol sent the first time it is seen */
+#define TABLEDVERSION 0x81 /* version byte of an input coded with a */
+#define TABLEDHDRLEN 8     /* shared table, then its 4 byte length */
+#define TABLEVERSION 0x82  /* version byte of a table file, */
+#define TABLELEN (MAGICLEN + 1 + LENGTHSLEN) /* then 128 bytes of lengths */
+
+typedef struct node {
+  uint64_t freq; /* 64-bit, so inputs over 4 GB can't overflow */
+  int c;
+  int left, right; /* positions of the children in the tree, or NOCHILD */
+} node;
+
+typedef struct tree {
+  node *a;  /* all 2n - 1 nodes: the sorted leaves, then the parents */
+  int len;  /* number of leaves */
+  int root;
+} tree;
+
+typedef struct treeLayout {
+  int *x, *y;     /* grid cell of each node, by its place in the tree */
+  int *height;    /* treeHeight() of each node */
+  int *offset;    /* distance from each node to its right child */
+  int xlen, ylen; /* grid cells the whole tree takes up */
+  int xoffset, yoffset; /* cells from a node to its right, left child */
+} treeLayout;
+
+typedef struct huffParams {
+  size_t blocksize; /* raw bytes per block, when compressing */
+  int maxcodelen;   /* 0 to use the populateTree() tree */
+  int threads;
+  int streams;      /* 1, or NSTREAMS to interleave each block */
+  int adaptive;     /* 1 for one-pass adaptive codes instead of blocks */
+  int pairs;        /* 1 to code blocks by byte pair where smaller */
+  int context;      /* 1 to code blocks by order-1 context where smaller */
+  size_t seek;      /* raw bytes between seek points, or 0 for none */
+  struct huffTable *table; /* shared codes to use instead, or NULL */
+} huffParams;
+
+typedef struct codeTable {
+  uint64_t code[ASIZE]; /* right-aligned bit pattern of each code */
+  int len[ASIZE];       /* number of bits in each code, 0 if unused */
+} codeTable;
+
+typedef struct decodeTable {
+  uint32_t entry[DECODESIZE]; /* primary table, then secondary tables */
+  int longest; /* longest code */
+  int bits; /* bits looked up in the primary table: 8, 10, 11 or
+             * TABLEBITS, the longest code rounded up */
+} decodeTable;
+
+typedef struct huffTable {
+  codeTable t;
+  decodeTable dt;
+} huffTable;
+
+typedef struct inputFile {
+  unsigned char *data;
+  size_t len;
+  int mapped; /* 1 if data is mmapped, 0 if it was read into memory */
+} inputFile;
+
+typedef struct huffCatch {
+  jmp_buf env; /* where an error in libhuff jumps back to */
+  void **mem;  /* allocMem() memory not yet freed */
+  int nmem, capmem;
+  FILE *files[CATCHFILES]; /* openFile() files not yet closed */
+  inputFile in; /* openInput() input not yet closed, if hasin */
+  int hasin;
+  char msg[CATCHMSGLEN]; /* what the error was, without "ERROR: " */
+} huffCatch;
+
+typedef struct countJob {
+  const unsigned char *p;
+  size_t n;
+  uint64_t freqs[ASIZE]; /* private to the thread counting this range */
+} countJob;
+
+typedef struct blockSlot {
+  unsigned char *buf; /* output of one block */
+  size_t len;
+  int ready; /* 1 once the block is done, until it is written out */
+} blockSlot;
+
+typedef struct blockJob {
+  const unsigned char *in;
+  uint64_t *inoff;  /* nblocks + 1 offsets of the blocks in the input */
+  uint64_t *outoff; /* likewise in the output, filled in as written */
+  uint64_t *rawoff; /* offsets to check decoded blocks against */
+  int nblocks, maxcodelen, streams, pairs, context, threads;
+  size_t bufsize; /* most output a block can make */
+  size_t seek;    /* seek interval, with an entry per block in seektab */
+  unsigned char *seektab;
+  void (*work)(struct blockJob *job, int b, blockSlot *s);
+  pthread_mutex_t lock; /* guards the rest */
+  pthread_cond_t cond;
+  int next, done; /* first block not yet started, and not yet written */
+  int window;
+  blockSlot *slots; /* block b works in slot b % window */
+} blockJob;
+
+typedef struct huffStream {
+  FILE *out;
+  size_t blocksize;
+  int maxcodelen, streams, pairs, context;
+  unsigned char *in;  /* bytes waiting to fill a block, or NULL */
+  size_t inlen;
+  unsigned char *buf; /* the block being written, or NULL until one is */
+  uint64_t *coff, *roff; /* index of the blocks written so far */
+  int nblocks, cap;
+} huffStream;
+
+typedef struct pipeSlot {
+  unsigned char *in, *out; /* a block as read, and as coded */
+  size_t inlen, outlen;
+  int done; /* 1 once coded, until it is written out */
+} pipeSlot;
+
+typedef struct pipeJob {
+  FILE *in, *out;
+  huffStream *stream; /* when compressing, to write the blocks to */
+  size_t insize, outsize; /* of the buffers of each slot */
+  int threads;
+  int (*read)(struct pipeJob *job, pipeSlot *s); /* 0 at the end */
+  void (*work)(struct pipeJob *job, pipeSlot *s);
+  void (*write)(struct pipeJob *job, pipeSlot *s);
+  pthread_mutex_t lock; /* guards the rest */
+  pthread_cond_t cond;
+  long nread, nstarted, nwritten; /* blocks read, taken and written */
+  int ended; /* 1 once the reader has reached the end */
+  int nslots;
+  pipeSlot *slots; /* block b is in slot b % nslots */
+} pipeJob;
+
+typedef struct bitWriter {
+  uint64_t acc; /* bits not yet written, right-aligned */
+  int nbits;
+  unsigned char *buf;
+  size_t pos;
+} bitWriter;
+
+typedef struct adaptNode {
+  uint64_t weight;
+  int parent, left, right; /* NOCHILD for the root's parent, a leaf's
+                              children */
+  int c; /* symbol of a leaf, or NOCHILD for NYT and parents */
+} adaptNode;
+
+typedef struct adaptTree {
+  adaptNode n[ADAPTNODES]; /* in sibling order, the root last */
+  int leaf[ADAPTSYMS]; /* node of each symbol seen so far, or NOCHILD */
+  int nyt;             /* node standing for every symbol not yet seen */
+} adaptTree;
+
+typedef struct huffAdapt {
+  FILE *out;
+  adaptTree tr;
+  bitWriter w;
+} huffAdapt;
+
+typedef struct bitReader {
+  uint64_t acc; /* unread bits, left-aligned */
+  int nbits;
+  const unsigned char *buf;
+  size_t pos, end;
+} bitReader;
+
+/* Frequency counting and tree-building functions (hufftree.c) */
+uint64_t *getFreqsFromFile(char *filename, uint64_t *arr, int threads);
+void sampleFreqs(const unsigned char *p, size_t n, int every, uint64_t *a);
+void countBytes(const unsigned char *p, size_t n, uint64_t *a);
+void countBytesParallel(const unsigned char *p, size_t n, uint64_t *a,
+  int threads);
+void *countWorker(void *arg);
+void padFreqs(uint64_t *a);
+void buildTree(uint64_t *a, tree *tr);
+int  calcNodeCnt(uint64_t *a);
+node *createNodeArray(uint64_t *a, int len);
+void setNode(node *p, int c, uint64_t freq, int left, int right);
+int  nodeComp(const void * a, const void * b);
+int  populateTree(tree *tr);
+int  takeSmallest(tree *tr, int *leaf, int *head, int tail);
+int  treeHeight(tree *tr, int n);
+
+/* Code construction functions (hufftree.c) */
+void buildCodes(uint64_t *a, int maxcodelen, codeTable *t);
+void buildCodeTable(tree *tr, codeTable *t);
+void fillCodeTable(tree *tr, int n, uint64_t code, int len, codeTable *t);
+void limitCodeLengths(codeTable *t, int maxlen);
+void packageMerge(uint64_t *a, int maxlen, codeTable *t);
+void assignCanonicalCodes(codeTable *t);
+
+/* Block encoding and decoding functions (huffcodec.c) */
+size_t encodeBlock(const unsigned char *p, size_t n, int maxcodelen,
+  int streams, int pairs, int context, unsigned char *out);
+size_t decodeBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t maxlen);
+size_t storeBlock(const unsigned char *p, size_t n, unsigned char *out);
+uint64_t codedBits(uint64_t *a, codeTable *t);
+double entropyBits(uint64_t *a);
+size_t maxBlockBytes(size_t n);
+void writeLengths(unsigned char *p, codeTable *t);
+void readLengths(const unsigned char *p, codeTable *t);
+void writeUint(unsigned char *p, uint64_t v, int nbytes);
+uint64_t readUint(const unsigned char *p, int nbytes);
+size_t encodeStreams(const unsigned char *p, size_t n, unsigned char *out,
+  codeTable *t);
+size_t encodeBytes(const unsigned char *p, size_t n, unsigned char *out,
+  codeTable *t);
+size_t encodeStride(const unsigned char *p, size_t n, int stride,
+  unsigned char *out, codeTable *t);
+size_t streamLen(size_t n, int k);
+void decodeStreams(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, codeTable *t);
+size_t decodeWords(bitReader *r, int streams, decodeTable *dt,
+  unsigned char *out, size_t len);
+void decodeBytes(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, codeTable *t);
+void decodeWithTable(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, decodeTable *dt);
+void decodeFrom(bitReader *r, decodeTable *dt, unsigned char *out,
+  size_t len);
+void startReader(bitReader *r, const unsigned char *p, size_t n);
+void seekReader(bitReader *r, const unsigned char *p, size_t n,
+  uint64_t bitoff);
+size_t encodeGroups(const unsigned char *p, size_t n, int stride,
+  bitWriter *w, codeTable *t);
+void storeWord(unsigned char *p, uint64_t word);
+void putBits(bitWriter *w, uint64_t code, int len);
+void flushWord(bitWriter *w, uint64_t word, int nbytes);
+void flushBits(bitWriter *w);
+void refillBits(bitReader *r);
+void buildDecodeTable(codeTable *t, decodeTable *dt);
+void fillEntries(uint32_t *e, int n, uint32_t value);
+int  decodeSymbol(bitReader *r, decodeTable *dt);
+
+/* Compressed file functions (hufffile.c) */
+void compressFile(char *inname, char *outname, huffParams *hp);
+void decompressFile(char *inname, char *outname, huffParams *hp);
+void compressAdaptiveFile(char *inname, char *outname);
+void decompressAdaptiveFile(inputFile *in, char *outname);
+void runBlocks(blockJob *job, FILE *out);
+void *blockWorker(void *arg);
+void compressBlock(blockJob *job, int b, blockSlot *s);
+void decompressBlock(blockJob *job, int b, blockSlot *s);
+void writeHeader(FILE *out, size_t blocksize);
+size_t readHeader(const unsigned char *p, size_t n);
+void writeIndex(FILE *out, int nblocks, uint64_t *coff, uint64_t *roff,
+  size_t seeklen);
+int  readIndex(inputFile *f, size_t blocksize, uint64_t **coff, 
+  uint64_t **roff);
+
+/* Streaming functions (hufffile.c) */
+void compressStream(FILE *in, FILE *out, huffParams *hp);
+void decompressStream(FILE *in, FILE *out, int threads);
+void huff_stream_init(huffStream *s, FILE *out, size_t blocksize, 
+  int maxcodelen, int streams, int pairs, int context);
+void huff_stream_write(huffStream *s, const void *data, size_t n);
+void huff_stream_flush(huffStream *s);
+void huff_stream_finish(huffStream *s);
+void huff_stream_decode(FILE *in, FILE *out);
+void streamBlock(huffStream *s, const unsigned char *p, size_t n);
+void writeStreamBlock(huffStream *s, const unsigned char *p, size_t len,
+  size_t n);
+void readBytes(FILE *in, unsigned char *p, size_t n);
+void skipBytes(FILE *in, size_t n);
+
+/* Adaptive coding functions (huffadapt.c) */
+void huff_adapt_init(huffAdapt *a, FILE *out);
+void huff_adapt_write(huffAdapt *a, const void *data, size_t n);
+void huff_adapt_flush(huffAdapt *a);
+void huff_adapt_finish(huffAdapt *a);
+void huff_adapt_decode(FILE *in, FILE *out);
+void compressAdaptive(FILE *in, FILE *out);
+void decodeAdaptive(bitReader *r, FILE *in, FILE *out);
+void encodeAdaptive(huffAdapt *a, int c);
+void writeAdaptive(huffAdapt *a);
+int  getBit(bitReader *r, FILE *in);
+void initAdaptTree(adaptTree *tr);
+void setAdaptNode(adaptTree *tr, int n, int parent, int c);
+void updateAdaptTree(adaptTree *tr, int c);
+int  findLeader(adaptTree *tr, int n);
+void swapAdaptNodes(adaptTree *tr, int i, int j);
+void relinkAdaptNode(adaptTree *tr, int n);
+
+/* Shared table functions (hufftable.c) */
+void trainTable(char **names, int n, int maxcodelen, int threads,
+  codeTable *t);
+void writeTable(char *name, codeTable *t);
+void loadTable(char *name, huffTable *ht);
+size_t tableBytes(size_t n);
+size_t huff_table_encode(huffTable *ht, const unsigned char *p, size_t n,
+  unsigned char *out);
+size_t huff_table_decode(huffTable *ht, const unsigned char *p, size_t n,
+  unsigned char *out, size_t maxlen);
+size_t tabledLength(const unsigned char *p, size_t n);
+void compressTableFile(char *inname, char *outname, huffTable *ht);
+void decompressTableFile(inputFile *in, char *outname, huffTable *ht);
+void writeOutput(char *name, const unsigned char *p, size_t n);
+
+/* Byte pair block functions (huffpair.c) */
+size_t encodePairBlock(const unsigned char *p, size_t n, size_t limit,
+  unsigned char *out);
+size_t decodePairBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len);
+size_t readPairTable(const unsigned char *p, size_t n, size_t len, 
+  unsigned char *lens);
+void decodePairs(const unsigned char *p, size_t n, size_t len, size_t at,
+  uint64_t bitoff, unsigned char *out, size_t count);
+int  pairLengths(const uint64_t *freqs, unsigned char *len);
+void pairCodes(unsigned char *len, uint32_t *code);
+uint32_t *buildPairTable(unsigned char *len, uint32_t *code);
+int  gapBytes(size_t g);
+int  writeGap(unsigned char *p, size_t g);
+size_t readGap(const unsigned char *p, size_t n, size_t *pos);
+void corruptPairs(void);
+
+/* Context block functions (huffctx.c) */
+size_t encodeContextBlock(const unsigned char *p, size_t n, int maxcodelen,
+  size_t limit, unsigned char *out);
+void decodeContextBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len);
+size_t readContextTables(const unsigned char *p, size_t n, 
+  unsigned char *map, codeTable *t, int *k);
+void decodeContexts(const unsigned char *p, size_t n, uint64_t bitoff, 
+  int prev, unsigned char *out, size_t count);
+void countContexts(const unsigned char *p, size_t n, uint64_t *h);
+int  clusterContexts(uint64_t *h, int maxcodelen, unsigned char *map,
+  codeTable *t, uint64_t *bits);
+int  buildContextTables(uint64_t *h, unsigned char *map, int k,
+  int maxcodelen, codeTable *t);
+uint64_t contextCost(uint64_t *h, codeTable *t);
+uint64_t contextBits(uint64_t *h, unsigned char *map, codeTable *t);
+
+/* Pipeline functions (huffpipe.c) */
+void runPipe(pipeJob *job);
+void *pipeReader(void *arg);
+void *pipeWorker(void *arg);
+int  readRawBlock(pipeJob *job, pipeSlot *s);
+void encodeSlot(pipeJob *job, pipeSlot *s);
+void writeCodedBlock(pipeJob *job, pipeSlot *s);
+int  readCodedBlock(pipeJob *job, pipeSlot *s);
+void decodeSlot(pipeJob *job, pipeSlot *s);
+void writeRawBlock(pipeJob *job, pipeSlot *s);
+
+/* Seek table functions (huffseek.c) */
+size_t seekEntries(size_t n, size_t every);
+void seekPoints(const unsigned char *blk, size_t blklen,
+  const unsigned char *p, size_t n, size_t every, unsigned char *out);
+void writeSeekTable(FILE *out, const unsigned char *p, size_t n,
+  size_t every);
+const unsigned char *readSeekTable(inputFile *f, int nblocks, uint64_t *coff,
+  uint64_t *roff, size_t *every);
+size_t decodeSpan(const unsigned char *p, size_t n, size_t len,
+  const unsigned char *seek, size_t every, size_t from, size_t to,
+  unsigned char *out);
+void decompressRange(char *inname, char *outname, uint64_t start,
+  uint64_t len);
+
+/* Tree layout functions (huffgrid.c) */
+char *parseTreeArgs(int argc, char **argv, int *all);
+uint64_t *countLetters(char *name, int all, uint64_t *a);
+void layoutTree(tree *tr, int xoffset, int yoffset, treeLayout *l);
+void measureTree(tree *tr, int n, treeLayout *l);
+void placeTree(tree *tr, int n, treeLayout *l, int y, int x, int *xmax);
+void freeLayout(treeLayout *l);
+
+/* Input and memory functions (hufffile.c) */
+FILE *openFile(char *name, char *mode);
+void closeFile(FILE *file, char *name);
+void openInput(char *filename, inputFile *f);
+void readInput(int fd, inputFile *f);
+void closeInput(inputFile *f);
+void trackInput(inputFile *f);
+void untrackInput(inputFile *f);
+void *allocMem(size_t size);
+void *reallocMem(void *p, size_t size);
+void freeMem(void *p);
+void trackMem(huffCatch *c, void *p);
+
+/* Error functions (hufffile.c) */
+void huff_catch_begin(huffCatch *c);
+void huff_catch_end(huffCatch *c);
+void makeCatchKey(void);
+huffCatch *getCatch(void);
+void huffError(const char *fmt, ...);
+void fail(void);
+
+#endif
@@ -0,0 +1,307 @@
+/* huffadapt.c
+ *
+ * Part of libhuff (see huff.h): one-pass adaptive huffman coding, by the
+ * FGK algorithm, for input that can't wait to be counted first.
+ *
+ * Encoder and decoder start from the same tree, holding only the NYT
+ * ("not yet transmitted") node, and update it in the same way after
+ * every char, so the tree is never sent and each char's code is written
+ * as soon as it is read.  A char seen for the first time is sent as the
+ * NYT code followed by the char in LITERALBITS bits, and gets a leaf of
+ * its own.  The alphabet has one more symbol, ADAPTEOF, which ends the
+ * data, so no length is needed up front and the output is just the
+ * magic, the ADAPTVERSION byte, and the bitstream.
+ *
+ * The tree keeps the sibling property: its nodes are numbered so that
+ * weights never decrease, with each pair of siblings next to each other
+ * and the root last.  To add one to a leaf's weight, each node on the
+ * way up is first swapped with the highest numbered node of the same
+ * weight, which keeps the numbering in order once it has gone up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+#define ADAPTROOT (ADAPTNODES - 1)
+#define ADAPTBUFSIZE 65536 /* encoder output written out past this */
+#define CODECHUNK 32 /* most bits of a code given to putBits() at once */
+
+void huff_adapt_init(huffAdapt *a, FILE *out)
+{
+  /* Starts an adaptive stream on out, with its four byte header. */
+  unsigned char hdr[ADAPTHDRLEN];
+
+  a->out = out;
+  initAdaptTree(&a->tr);
+  a->w.acc = 0;
+  a->w.nbits = 0;
+  a->w.buf = (unsigned char *)allocMem(ADAPTBUFSIZE + ACCBITS);
+  a->w.pos = 0;
+  memcpy(hdr, MAGIC, MAGICLEN);
+  hdr[MAGICLEN] = ADAPTVERSION;
+  if (fwrite(hdr, 1, ADAPTHDRLEN, out) != ADAPTHDRLEN) {
+    huffError("failed to write output");
+    fail();
+  }
+}
+
+void huff_adapt_write(huffAdapt *a, const void *data, size_t n)
+{
+  /* Encodes n more bytes.  Their codes are buffered until there are
+   * ADAPTBUFSIZE bytes of them, or huff_adapt_flush(). */
+  const unsigned char *p = (const unsigned char *)data;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    encodeAdaptive(a, p[i]);
+    if (a->w.pos >= ADAPTBUFSIZE) {
+      writeAdaptive(a);
+    }
+  }
+}
+
+void huff_adapt_flush(huffAdapt *a)
+{
+  /* Writes out every whole byte of code so far.  Up to 7 bits of the
+   * last char can't be sent until the next char fills their byte. */
+  bitWriter *w = &a->w;
+  int nbytes = w->nbits / BITSPERBYTE;
+
+  if (nbytes > 0) {
+    flushWord(w, w->acc << (ACCBITS - w->nbits), nbytes);
+    w->nbits -= nbytes * BITSPERBYTE;
+    w->acc &= ((uint64_t)1 << w->nbits) - 1;
+  }
+  writeAdaptive(a);
+  if (fflush(a->out) != 0) {
+    huffError("failed to write output");
+    fail();
+  }
+}
+
+void huff_adapt_finish(huffAdapt *a)
+{
+  /* ends the stream with ADAPTEOF, writes it all out, and frees it */
+  encodeAdaptive(a, ADAPTEOF);
+  flushBits(&a->w);
+  huff_adapt_flush(a);
+  freeMem(a->w.buf);
+}
+
+void huff_adapt_decode(FILE *in, FILE *out)
+{
+  /* Decodes an adaptive stream after its header, reading in only as
+   * far as each char needs, so chars come out as soon as they arrive. */
+  bitReader r;
+
+  startReader(&r, NULL, 0);
+  decodeAdaptive(&r, in, out);
+}
+
+void compressAdaptive(FILE *in, FILE *out)
+{
+  huffAdapt a;
+  unsigned char *buf = (unsigned char *)allocMem(ADAPTBUFSIZE);
+  size_t n;
+
+  huff_adapt_init(&a, out);
+  while ((n = fread(buf, 1, ADAPTBUFSIZE, in)) > 0) {
+    huff_adapt_write(&a, buf, n);
+  }
+  if (ferror(in)) {
+    huffError("failed to read input");
+    fail();
+  }
+  huff_adapt_finish(&a);
+  freeMem(buf);
+}
+
+void decodeAdaptive(bitReader *r, FILE *in, FILE *out)
+{
+  /* Decodes chars until ADAPTEOF, from the bytes left in r and then,
+   * if in isn't NULL, from in */
+  adaptTree tr;
+  int n, c, i;
+
+  initAdaptTree(&tr);
+  do {
+    for (n = ADAPTROOT; tr.n[n].left != NOCHILD; ) {
+      n = getBit(r, in) ? tr.n[n].right : tr.n[n].left;
+    }
+    if (n == tr.nyt) {
+      for (c = 0, i = 0; i < LITERALBITS; i++) {
+        c = (c << 1) | getBit(r, in);
+      }
+      if (c >= ADAPTSYMS || tr.leaf[c] != NOCHILD) {
+        huffError("invalid code in compressed data");
+        fail();
+      }
+    }
+    else {
+      c = tr.n[n].c;
+    }
+    if (c != ADAPTEOF && putc(c, out) == EOF) {
+      huffError("failed to write output");
+      fail();
+    }
+    updateAdaptTree(&tr, c);
+  } while (c != ADAPTEOF);
+}
+
+void encodeAdaptive(huffAdapt *a, int c)
+{
+  /* Writes the code of c, which is the path from the root to its leaf,
+   * or to NYT followed by c itself, and then updates the tree.  The path
+   * is found from the leaf upwards, so it is written out backwards. */
+  adaptTree *tr = &a->tr;
+  char bit[ADAPTSYMS + 1]; /* the deepest leaf, with NYT the only other */
+  uint64_t code;
+  int n, depth = 0, len;
+
+  n = tr->leaf[c] == NOCHILD ? tr->nyt : tr->leaf[c];
+  for (; n != ADAPTROOT; n = tr->n[n].parent) {
+    bit[depth++] = tr->n[tr->n[n].parent].right == n;
+  }
+  while (depth > 0) {
+    for (code = 0, len = 0; len < CODECHUNK && depth > 0; len++) {
+      code = (code << 1) | bit[--depth];
+    }
+    putBits(&a->w, code, len);
+  }
+  if (tr->leaf[c] == NOCHILD) {
+    putBits(&a->w, c, LITERALBITS);
+  }
+  updateAdaptTree(tr, c);
+}
+
+void writeAdaptive(huffAdapt *a)
+{
+  if (fwrite(a->w.buf, 1, a->w.pos, a->out) != a->w.pos) {
+    huffError("failed to write output");
+    fail();
+  }
+  a->w.pos = 0;
+}
+
+int getBit(bitReader *r, FILE *in)
+{
+  /* the next bit, refilling r from memory, or a byte at a time from in
+   * so as not to wait for more than the code needs */
+  int c;
+
+  if (r->nbits == 0) {
+    if (r->pos < r->end) {
+      refillBits(r);
+    }
+    else if (in != NULL && (c = getc(in)) != EOF) {
+      r->acc = (uint64_t)c << (ACCBITS - BITSPERBYTE);
+      r->nbits = BITSPERBYTE;
+    }
+    else {
+      huffError("compressed data is truncated");
+      fail();
+    }
+  }
+  c = r->acc >> (ACCBITS - 1);
+  r->acc <<= 1;
+  r->nbits--;
+  return c;
+}
+
+void initAdaptTree(adaptTree *tr)
+{
+  int i;
+
+  for (i = 0; i < ADAPTSYMS; i++) {
+    tr->leaf[i] = NOCHILD;
+  }
+  setAdaptNode(tr, ADAPTROOT, NOCHILD, NOCHILD);
+  tr->nyt = ADAPTROOT;
+}
+
+void setAdaptNode(adaptTree *tr, int n, int parent, int c)
+{
+  /* a leaf of weight 0 */
+  tr->n[n].weight = 0;
+  tr->n[n].parent = parent;
+  tr->n[n].left = tr->n[n].right = NOCHILD;
+  tr->n[n].c = c;
+}
+
+void updateAdaptTree(adaptTree *tr, int c)
+{
+  /* Adds one to the weight of c, first giving it a leaf, split off from
+   * NYT, if it is new. */
+  int n = tr->leaf[c], lead, old;
+
+  if (n == NOCHILD) {
+    old = tr->nyt;
+    tr->n[old].left = old - 2;
+    tr->n[old].right = old - 1;
+    setAdaptNode(tr, old - 1, old, c);
+    setAdaptNode(tr, old - 2, old, NOCHILD);
+    tr->leaf[c] = n = old - 1;
+    tr->nyt = old - 2;
+  }
+  for (; n != NOCHILD; n = tr->n[n].parent) {
+    lead = findLeader(tr, n);
+    if (lead != n && lead != tr->n[n].parent) {
+      swapAdaptNodes(tr, n, lead);
+      n = lead;
+    }
+    tr->n[n].weight++;
+  }
+}
+
+int findLeader(adaptTree *tr, int n)
+{
+  /* the highest numbered node with the same weight as n - as weights
+   * never decrease with the numbering, this is a binary search */
+  uint64_t w = tr->n[n].weight;
+  int lo = n, hi = ADAPTROOT, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if (tr->n[mid].weight == w) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+void swapAdaptNodes(adaptTree *tr, int i, int j)
+{
+  /* Swaps the subtrees at nodes i and j, which have the same weight.
+   * Each keeps its place in the tree, so only what hangs off it moves. */
+  adaptNode t = tr->n[i];
+
+  tr->n[i].left = tr->n[j].left;
+  tr->n[i].right = tr->n[j].right;
+  tr->n[i].c = tr->n[j].c;
+  tr->n[j].left = t.left;
+  tr->n[j].right = t.right;
+  tr->n[j].c = t.c;
+  relinkAdaptNode(tr, i);
+  relinkAdaptNode(tr, j);
+}
+
+void relinkAdaptNode(adaptTree *tr, int n)
+{
+  /* points the children, or the leaf of the char, back at n */
+  if (tr->n[n].left == NOCHILD && tr->n[n].c == NOCHILD) {
+    tr->nyt = n;
+  }
+  else if (tr->n[n].left == NOCHILD) {
+    tr->leaf[tr->n[n].c] = n;
+  }
+  else {
+    tr->n[tr->n[n].left].parent = n;
+    tr->n[tr->n[n].right].parent = n;
+  }
+}
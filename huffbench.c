@@ -0,0 +1,316 @@
+/* huffbench.c
+ *
+ * Function: times each stage of compression on its own, over the files
+ * given in argv and over large synthetic inputs, to catch performance
+ * regressions and compare the two ways of building codes.
+ * Usage: filename [-r repeats] [-s MB] [files...]
+ *        -r  timed runs of each stage (default 7)
+ *        -s  size of each synthetic input in MB, 0 for none (default 32)
+ * Run over txt/ by 'make bench'.
+ *
+ * The stages are: counting the bytes, building the populateTree() tree,
+ * turning the tree into canonical codes, building codes by package-merge
+ * instead, encoding with the codes, and decoding again, then encoding
+ * and decoding as NSTREAMS interleaved streams.  Each stage is
+ * run once to warm up, which also works out how many calls it takes to
+ * fill MINSAMPLE seconds, so quick stages like building the tree are
+ * still timed accurately.  Then it is timed over repeats runs of that
+ * many calls, and the median kept, which ignores the odd slow run.
+ *
+ * Output is one tab-separated line per input and stage, after a header
+ * line starting with '#': the input, the stage, its length in bytes,
+ * the median time of one call in ns, ns per input byte (or symbol),
+ * MB/s of input, and for the encoding stages the size of what they
+ * wrote, with the code lengths, over the input size, or '-' for the
+ * others.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "huff.h"
+
+#define REPEATS 7 /* default timed runs of each stage */
+#define MAXREPEATS 101
+#define MINSAMPLE 0.02 /* shortest time, in s, of one timed run */
+#define SYNTHMB 32 /* default size of each synthetic input */
+#define SEED 0x5eedUL /* synthetic inputs are the same every time */
+#define NSTAGES 8
+
+typedef struct benchData {
+  const unsigned char *p; /* the input */
+  size_t n;
+  uint64_t freqs[ASIZE];
+  tree tr;
+  codeTable t;
+  unsigned char *enc; /* the input encoded with t */
+  size_t enclen;
+  unsigned char *enc4; /* and as NSTREAMS streams */
+  size_t enc4len;
+  unsigned char *dec;
+} benchData;
+
+typedef struct benchStage {
+  char *name;
+  void (*run)(benchData *b);
+  int decodes; /* 1 if the output is checked against the input */
+  int streams;  /* 1 or NSTREAMS if it encodes, for its ratio, or 0 */
+} benchStage;
+
+void benchInput(char *name, const unsigned char *p, size_t n, int repeats);
+double timeStage(void (*run)(benchData *b), benchData *b, int repeats);
+double getSeconds(void);
+int  doubleComp(const void *a, const void *b);
+void makeSynthetic(unsigned char *p, size_t n, int skewed);
+uint64_t nextRandom(uint64_t *state);
+
+void stageHistogram(benchData *b);
+void stageTree(benchData *b);
+void stageCodes(benchData *b);
+void stagePackageMerge(benchData *b);
+void stageEncode(benchData *b);
+void stageDecode(benchData *b);
+void stageEncode4(benchData *b);
+void stageDecode4(benchData *b);
+
+benchStage stages[NSTAGES] = {
+  {"histogram", stageHistogram, 0, 0},
+  {"tree", stageTree, 0, 0},
+  {"codes", stageCodes, 0, 0},
+  {"packagemerge", stagePackageMerge, 0, 0},
+  {"encode", stageEncode, 0, 1},
+  {"decode", stageDecode, 1, 0},
+  {"encode4", stageEncode4, 0, NSTREAMS},
+  {"decode4", stageDecode4, 1, 0}
+};
+
+int main(int argc, char **argv)
+{
+  int i, repeats = REPEATS;
+  size_t synth = SYNTHMB;
+  unsigned char *p;
+  inputFile f;
+
+  for (i = 1; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+    if (strcmp(argv[i], "-r") == 0) {
+      repeats = atoi(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "-s") == 0) {
+      synth = strtoul(argv[i + 1], NULL, 10);
+    }
+    else {
+      break;
+    }
+  }
+  if (repeats < 1 || repeats > MAXREPEATS || synth > MAXBLOCKSIZE >> 20) {
+    fprintf(stderr, "Usage: %s [-r repeats (1 - %d)] [-s MB (0 - %d)]"
+      " [files...]\n", argv[0], MAXREPEATS, MAXBLOCKSIZE >> 20);
+    exit(1);
+  }
+
+  fprintf(stdout, "# input\tstage\tbytes\tmedian_ns\tns_per_byte"
+    "\tMB_per_s\tratio\n");
+  for (; i < argc; i++) {
+    openInput(argv[i], &f);
+    benchInput(argv[i], f.data, f.len, repeats);
+    closeInput(&f);
+  }
+
+  if (synth > 0) {
+    synth <<= 20;
+    p = (unsigned char *)allocMem(synth);
+    makeSynthetic(p, synth, 0);
+    benchInput("synthetic-uniform", p, synth, repeats);
+    makeSynthetic(p, synth, 1);
+    benchInput("synthetic-skewed", p, synth, repeats);
+    freeMem(p);
+  }
+  return 0;
+}
+
+void benchInput(char *name, const unsigned char *p, size_t n, int repeats)
+{
+  /* times every stage over p, after making the codes and encoded copy
+   * that the later stages start from */
+  benchData b;
+  double t;
+  int i;
+
+  if (n == 0) {
+    fprintf(stderr, "skipping empty input %s\n", name);
+    return;
+  }
+  b.p = p;
+  b.n = n;
+  memset(b.freqs, 0, sizeof(b.freqs));
+  countBytes(p, n, b.freqs);
+  padFreqs(b.freqs);
+  buildTree(b.freqs, &b.tr);
+  buildCodes(b.freqs, 0, &b.t);
+  b.enc = (unsigned char *)allocMem(maxBlockBytes(n));
+  b.enc4 = (unsigned char *)allocMem(maxBlockBytes(n));
+  b.dec = (unsigned char *)allocMem(n);
+  b.enclen = encodeBytes(p, n, b.enc, &b.t);
+  b.enc4len = encodeStreams(p, n, b.enc4, &b.t);
+
+  for (i = 0; i < NSTAGES; i++) {
+    t = timeStage(stages[i].run, &b, repeats);
+    fprintf(stdout, "%s\t%s\t%lu\t%.0f\t%.3f\t%.1f", name,
+      stages[i].name, (unsigned long)n, t * 1e9, t * 1e9 / n, n / t / 1e6);
+    if (stages[i].streams == 0) {
+      fprintf(stdout, "\t-\n");
+    }
+    else {
+      /* what the block would hold: the code lengths, then the encoding,
+       * which for NSTREAMS has the stream lengths too */
+      fprintf(stdout, "\t%.4f\n", (double)(LENGTHSLEN + (stages[i].streams
+        == NSTREAMS ? b.enc4len : b.enclen)) / n);
+    }
+    fflush(stdout);
+    if (stages[i].decodes) {
+      if (memcmp(b.dec, p, n) != 0) {
+        fprintf(stderr, "ERROR: %s did not decode to the input\n", name);
+        exit(EXIT_FAILURE);
+      }
+      memset(b.dec, 0, n);
+    }
+  }
+
+  freeMem(b.tr.a);
+  freeMem(b.enc);
+  freeMem(b.enc4);
+  freeMem(b.dec);
+}
+
+double timeStage(void (*run)(benchData *b), benchData *b, int repeats)
+{
+  /* the median time of one call to run, over repeats timed runs */
+  double sample[MAXREPEATS], start, t;
+  long calls = 1, i;
+  int r;
+
+  do {
+    start = getSeconds();
+    for (i = 0; i < calls; i++) {
+      run(b);
+    }
+    t = getSeconds() - start;
+    calls *= 2;
+  } while (t < MINSAMPLE);
+  calls /= 2;
+
+  for (r = 0; r < repeats; r++) {
+    start = getSeconds();
+    for (i = 0; i < calls; i++) {
+      run(b);
+    }
+    sample[r] = (getSeconds() - start) / calls;
+  }
+  qsort(sample, repeats, sizeof(double), doubleComp);
+  return sample[repeats / 2];
+}
+
+double getSeconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int doubleComp(const void *a, const void *b)
+{
+  double d1 = *(const double *)a;
+  double d2 = *(const double *)b;
+
+  return (d1 > d2) - (d1 < d2);
+}
+
+void makeSynthetic(unsigned char *p, size_t n, int skewed)
+{
+  /* Uniform bytes, which don't compress at all, or skewed ones where
+   * each value is half as likely as the one before, which give the
+   * deepest trees.  The same seed makes the same input every time. */
+  uint64_t state = SEED, r;
+  size_t i;
+  int c;
+
+  for (i = 0; i < n; i++) {
+    r = nextRandom(&state) >> 32; /* the low bits of an LCG are poor */
+    if (!skewed) {
+      p[i] = r >> 24;
+      continue;
+    }
+    for (c = 0; c < ASIZE - 1 && (r & 1); c++) {
+      r >>= 1;
+      if (c % 32 == 31) {
+        r = nextRandom(&state) >> 32;
+      }
+    }
+    p[i] = c;
+  }
+}
+
+uint64_t nextRandom(uint64_t *state)
+{
+  /* 64-bit LCG (Knuth's MMIX constants), so results don't depend on the
+   * C library's rand() */
+  *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+  return *state;
+}
+
+void stageHistogram(benchData *b)
+{
+  uint64_t freqs[ASIZE] = {0};
+
+  countBytes(b->p, b->n, freqs);
+}
+
+void stageTree(benchData *b)
+{
+  tree tr;
+
+  buildTree(b->freqs, &tr);
+  freeMem(tr.a);
+}
+
+void stageCodes(benchData *b)
+{
+  codeTable t;
+
+  buildCodeTable(&b->tr, &t);
+  limitCodeLengths(&t, MAXCODELEN);
+  assignCanonicalCodes(&t);
+}
+
+void stagePackageMerge(benchData *b)
+{
+  codeTable t;
+
+  packageMerge(b->freqs, MAXCODELEN, &t);
+  assignCanonicalCodes(&t);
+}
+
+void stageEncode(benchData *b)
+{
+  encodeBytes(b->p, b->n, b->enc, &b->t);
+}
+
+void stageDecode(benchData *b)
+{
+  decodeBytes(b->enc, b->enclen, b->dec, b->n, &b->t);
+}
+
+void stageEncode4(benchData *b)
+{
+  encodeStreams(b->p, b->n, b->enc4, &b->t);
+}
+
+void stageDecode4(benchData *b)
+{
+  decodeStreams(b->enc4, b->enc4len, b->dec, b->n, &b->t);
+}
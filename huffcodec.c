@@ -0,0 +1,1013 @@
+/* huffcodec.c
+ * 
+ * Part of libhuff (see huff.h): compresses and decompresses one block.
+ *
+ * Each block has its type, uncompressed length and compressed length,
+ * one length nibble for each of the 256 byte values, in LENGTHSLEN =
+ * 128 bytes, and the codes as a bitstream, most significant bit first,
+ * collected in a 64-bit accumulator which is written out a whole word
+ * at a time.
+ * A BLOCKHUFF4 block deals its chars out in turn to NSTREAMS bitstreams
+ * instead, one after another, with the lengths of all but the last
+ * after the code lengths, so the decoder can work on NSTREAMS codes at
+ * once rather than waiting for each code to know where the next starts.
+ * The encoder does ENCGROUP chars per step without branching on the
+ * code lengths: each pair of codes is joined and added to the
+ * accumulator, which is then stored as a whole word whether it is full
+ * or not, and moved on by the whole bytes it held.
+ * With pairs or context, a block that codes smaller by byte pair or by
+ * order-1 context is left to huffpair.c or huffctx.c.
+ * A block that wouldn't code to less than all but 1/STOREMARGIN of its
+ * length, such as one already compressed, is written as a BLOCKRAW
+ * block instead, the header and the bytes as they are, so it costs
+ * neither a whole encode to find out nor a decode to read back.  This
+ * is worked out from the counts alone: first their entropy, which no
+ * code can beat, then the exact bits of the codes built from them.
+ * The decoder looks up the next bits in a table which gives the char
+ * and its code length directly.  The table is as wide as the block's
+ * longest code, rounded up to 8, 10, 11 or TABLEBITS bits, and only codes
+ * longer than TABLEBITS are sent on to a smaller secondary table for the
+ * remaining bits.  There is a decode loop for each width, for one
+ * stream and for NSTREAMS, picked once for the block by decodeWords(),
+ * in which the width, the number of streams and the number of codes a
+ * word has room for are all fixed, so the compiler can unroll it.  They
+ * share loadWords() and differ only in their lookups.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "huff.h"
+
+#define ENCGROUP 4 /* chars encoded per step, two codes at a time */
+#define NOCODE 0x80000000UL /* encode table entry for a char with no code */
+#define GROUP8 7 /* codes of 8 bits or less each load has room for, */
+#define GROUP10 5 /* of 10 or 11 bits, */
+#define GROUP12 4 /* of TABLEBITS bits */
+#define DECGROUP 3 /* and of MAXCODELEN bits, with secondary tables */
+#define STOREMARGIN 32 /* a block is stored unless coding saves 1/32 */
+
+/* the decode loops, one for each table width and layout, picked by
+ * decodeWords(), and the word loads they share */
+typedef size_t (*decodeLoop)(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeRun8(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeRun10(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeRun11(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeRun12(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeRunLong(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeGroups8(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeGroups10(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeGroups11(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeGroups12(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static size_t decodeGroupsLong(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid);
+static void loadWords(bitReader *r, int streams);
+static int  wordsLeft(bitReader *r, int streams);
+
+size_t encodeBlock(const unsigned char *p, size_t n, int maxcodelen,
+  int streams, int pairs, int context, unsigned char *out)
+{
+  /* Writes the block header, the code lengths and the bitstream of p,
+   * or NSTREAMS of them if streams is NSTREAMS, and returns the number
+   * of bytes written.  With pairs or context, a BLOCKPAIR or BLOCKCTX
+   * block is written instead if it comes out smaller.  A pair block is
+   * only written over a context block if it is smaller again.  If none
+   * would save 1/STOREMARGIN of the block, it is stored as it is. */
+  uint64_t freqs[ASIZE] = {0};
+  codeTable t;
+  size_t len, best = 0, limit = BLOCKHDRLEN + n - n / STOREMARGIN;
+  int store;
+
+  /* the entropy is as few bits as any code could take, so if even that
+   * is too long the codes needn't be built */
+  countBytes(p, n, freqs);
+  store = BLOCKHDRLEN + LENGTHSLEN + entropyBits(freqs) / BITSPERBYTE
+    >= limit;
+  if (!store) {
+    padFreqs(freqs);
+    buildCodes(freqs, maxcodelen, &t);
+    len = BLOCKHDRLEN + LENGTHSLEN
+      + (codedBits(freqs, &t) + BITSPERBYTE - 1) / BITSPERBYTE;
+    if (streams == NSTREAMS) {
+      len += STREAMSLEN + NSTREAMS;
+    }
+    store = len >= limit;
+  }
+  if (store) {
+    len = limit;
+  }
+
+  if (pairs || context) {
+    if (context && (best = encodeContextBlock(p, n, maxcodelen, len, out))
+      != 0) {
+      len = best;
+    }
+    if (pairs && (len = encodePairBlock(p, n, len, out)) != 0) {
+      return len;
+    }
+    if (best != 0) {
+      return best;
+    }
+  }
+  if (store) {
+    return storeBlock(p, n, out);
+  }
+
+  writeLengths(out + BLOCKHDRLEN, &t);
+  if (streams == NSTREAMS) {
+    len = encodeStreams(p, n, out + BLOCKHDRLEN + LENGTHSLEN, &t);
+  }
+  else {
+    len = encodeBytes(p, n, out + BLOCKHDRLEN + LENGTHSLEN, &t);
+  }
+  len += LENGTHSLEN;
+  out[0] = streams == NSTREAMS ? BLOCKHUFF4 : BLOCKHUFF;
+  writeUint(out + 1, n, 4);
+  writeUint(out + 5, len, 4);
+  return BLOCKHDRLEN + len;
+}
+
+size_t storeBlock(const unsigned char *p, size_t n, unsigned char *out)
+{
+  /* writes p as a BLOCKRAW block and returns its length */
+  out[0] = BLOCKRAW;
+  writeUint(out + 1, n, 4);
+  writeUint(out + 5, n, 4);
+  memcpy(out + BLOCKHDRLEN, p, n);
+  return BLOCKHDRLEN + n;
+}
+
+uint64_t codedBits(uint64_t *a, codeTable *t)
+{
+  /* the bits the chars counted in a take with the codes of t */
+  uint64_t bits = 0;
+  int c;
+
+  for (c = 0; c < ASIZE; c++) {
+    bits += a[c] * t->len[c];
+  }
+  return bits;
+}
+
+double entropyBits(uint64_t *a)
+{
+  /* the fewest bits any code, one char at a time, could take for the
+   * chars counted in a */
+  double n = 0, bits = 0;
+  int c;
+
+  for (c = 0; c < ASIZE; c++) {
+    n += a[c];
+  }
+  for (c = 0; c < ASIZE; c++) {
+    if (a[c] != 0) {
+      bits -= a[c] * log(a[c] / n) / log(2.0);
+    }
+  }
+  return bits;
+}
+
+size_t decodeBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t maxlen)
+{
+  /* Decodes the n byte block at p into out, and returns its length */
+  codeTable t;
+  size_t len = 0;
+
+  if (n < BLOCKHDRLEN
+    || p[0] > BLOCKRAW
+    || (p[0] != BLOCKPAIR && p[0] != BLOCKRAW
+    && n < BLOCKHDRLEN + LENGTHSLEN)
+    || readUint(p + 5, 4) != n - BLOCKHDRLEN
+    || (len = readUint(p + 1, 4)) > maxlen
+    || (p[0] == BLOCKRAW && len != n - BLOCKHDRLEN)) {
+    huffError("corrupt block header");
+    fail();
+  }
+  if (p[0] == BLOCKRAW) {
+    memcpy(out, p + BLOCKHDRLEN, len);
+    return len;
+  }
+  if (p[0] == BLOCKPAIR) {
+    return decodePairBlock(p, n, out, len);
+  }
+  if (p[0] == BLOCKCTX) {
+    decodeContextBlock(p, n, out, len);
+    return len;
+  }
+  readLengths(p + BLOCKHDRLEN, &t);
+  assignCanonicalCodes(&t);
+  if (p[0] == BLOCKHUFF4) {
+    decodeStreams(p + BLOCKHDRLEN + LENGTHSLEN, 
+      n - BLOCKHDRLEN - LENGTHSLEN, out, len, &t);
+  }
+  else {
+    decodeBytes(p + BLOCKHDRLEN + LENGTHSLEN, n - BLOCKHDRLEN - LENGTHSLEN,
+      out, len, &t);
+  }
+  return len;
+}
+
+size_t maxBlockBytes(size_t n)
+{
+  /* the most a block of n bytes can take up, when every code is as
+   * long as it can be and each stream ends with a part-filled byte */
+  return BLOCKHDRLEN + LENGTHSLEN + STREAMSLEN + NSTREAMS
+    + (n * MAXCODELEN + BITSPERBYTE - 1) / BITSPERBYTE;
+}
+
+void writeLengths(unsigned char *p, codeTable *t)
+{
+  /* one nibble for each byte value, the even one in the low nibble */
+  int i;
+
+  for (i = 0; i < HDRSYMS; i += 2) {
+    p[i / 2] = t->len[i] | (t->len[i + 1] << 4);
+  }
+}
+
+void readLengths(const unsigned char *p, codeTable *t)
+{
+  unsigned long kraft = 0;
+  int i, l;
+
+  memset(t, 0, sizeof(codeTable));
+  for (i = 0; i < HDRSYMS; i++) {
+    l = i % 2 == 0 ? p[i / 2] & 0xF : p[i / 2] >> 4;
+    if (l != 0) {
+      t->len[i] = l;
+      kraft += 1UL << (MAXCODELEN - l);
+    }
+  }
+  /* the lengths must leave room for every code */
+  if (kraft > 1UL << MAXCODELEN) {
+    huffError("corrupt code length table");
+    fail();
+  }
+}
+
+void writeUint(unsigned char *p, uint64_t v, int nbytes)
+{
+  /* little-endian, so the format doesn't depend on the host */
+  int i;
+
+  for (i = 0; i < nbytes; i++) {
+    p[i] = (v >> (i * BITSPERBYTE)) & 0xFF;
+  }
+}
+
+uint64_t readUint(const unsigned char *p, int nbytes)
+{
+  uint64_t v = 0;
+  int i;
+
+  for (i = 0; i < nbytes; i++) {
+    v |= (uint64_t)p[i] << (i * BITSPERBYTE);
+  }
+  return v;
+}
+
+size_t encodeStreams(const unsigned char *p, size_t n, unsigned char *out,
+  codeTable *t)
+{
+  /* writes the lengths of the streams, then stream k with chars k,
+   * k + NSTREAMS, and so on, and returns the number of bytes written */
+  size_t len = STREAMSLEN, slen;
+  int k;
+
+  for (k = 0; k < NSTREAMS; k++) {
+    slen = encodeStride(p + k, streamLen(n, k), NSTREAMS, out + len, t);
+    if (k < NSTREAMS - 1) {
+      writeUint(out + 4 * k, slen, 4);
+    }
+    len += slen;
+  }
+  return len;
+}
+
+size_t encodeBytes(const unsigned char *p, size_t n, unsigned char *out,
+  codeTable *t)
+{
+  /* writes the codes of p to out, which must have room for
+   * maxBlockBytes(n), and returns the number of bytes written */
+  return encodeStride(p, n, 1, out, t);
+}
+
+size_t encodeStride(const unsigned char *p, size_t n, int stride,
+  unsigned char *out, codeTable *t)
+{
+  /* likewise for the n chars p[0], p[stride], p[2 * stride]... */
+  bitWriter w;
+  size_t i;
+
+  w.acc = 0;
+  w.nbits = 0;
+  w.buf = out;
+  w.pos = 0;
+
+  i = encodeGroups(p, n, stride, &w, t);
+  for (p += i * stride; i < n; i++, p += stride) {
+    if (t->len[*p] == 0) {
+      huffError("input changed while compressing");
+      fail();
+    }
+    putBits(&w, t->code[*p], t->len[*p]);
+  }
+  flushBits(&w);
+  return w.pos;
+}
+
+size_t streamLen(size_t n, int k)
+{
+  /* how many of n chars, dealt out in turn, go to stream k */
+  return (n + NSTREAMS - 1 - k) / NSTREAMS;
+}
+
+size_t encodeGroups(const unsigned char *p, size_t n, int stride,
+  bitWriter *w, codeTable *t)
+{
+  /* Encodes p ENCGROUP chars at a time, from each char's code and length
+   * in one table entry, and returns how many chars it did.  It is a
+   * scalar loop, 4 chars a step, not SIMD: grouping only saves branches
+   * and stores.  Each word stored can reach 8 bytes past the bits
+   * written so far, so it stops while the rest of p, at MAXCODELEN bits
+   * a char, could still fill those; putBits() does the last few chars. */
+  uint32_t enc[ASIZE], seen = 0, e0, e1, e2, e3;
+  uint64_t acc = w->acc;
+  unsigned nbits = w->nbits;
+  unsigned char *out = w->buf + w->pos;
+  size_t i;
+  int c;
+
+  for (c = 0; c < ASIZE; c++) {
+    enc[c] = t->len[c] == 0 ? NOCODE 
+      : ((uint32_t)t->code[c] << ENTRYSHIFT) | t->len[c];
+  }
+
+  for (i = 0; i + ENCGROUP + ACCBITS / MAXCODELEN + 1 <= n; i += ENCGROUP) {
+    e0 = enc[p[0]];
+    e1 = enc[p[stride]];
+    e2 = enc[p[2 * stride]];
+    e3 = enc[p[3 * stride]];
+    p += ENCGROUP * stride;
+    seen |= e0 | e1 | e2 | e3;
+
+    /* at most 7 bits are left over from the last word, so two codes of
+     * MAXCODELEN bits still fit in the accumulator */
+    acc = (acc << (e0 & LENMASK)) | (e0 >> ENTRYSHIFT);
+    acc = (acc << (e1 & LENMASK)) | (e1 >> ENTRYSHIFT);
+    nbits += (e0 & LENMASK) + (e1 & LENMASK);
+    storeWord(out, (acc << (ACCBITS - 1 - nbits)) << 1);
+    out += nbits / BITSPERBYTE;
+    nbits %= BITSPERBYTE;
+
+    acc = (acc << (e2 & LENMASK)) | (e2 >> ENTRYSHIFT);
+    acc = (acc << (e3 & LENMASK)) | (e3 >> ENTRYSHIFT);
+    nbits += (e2 & LENMASK) + (e3 & LENMASK);
+    storeWord(out, (acc << (ACCBITS - 1 - nbits)) << 1);
+    out += nbits / BITSPERBYTE;
+    nbits %= BITSPERBYTE;
+  }
+
+  if (seen & NOCODE) {
+    huffError("input changed while compressing");
+    fail();
+  }
+  w->acc = acc & (((uint64_t)1 << nbits) - 1);
+  w->nbits = nbits;
+  w->pos = out - w->buf;
+  return i;
+}
+
+void storeWord(unsigned char *p, uint64_t word)
+{
+  /* most significant byte first, which compilers make one store */
+  p[0] = word >> 56;
+  p[1] = word >> 48;
+  p[2] = word >> 40;
+  p[3] = word >> 32;
+  p[4] = word >> 24;
+  p[5] = word >> 16;
+  p[6] = word >> 8;
+  p[7] = word;
+}
+
+void putBits(bitWriter *w, uint64_t code, int len)
+{
+  /* Appends len bits to the accumulator.  When it fills up, the top
+   * part of the code completes the word, which is written out, and the
+   * leftover bits start the next one. */
+  int spill = w->nbits + len - ACCBITS;
+
+  if (spill < 0) {
+    w->acc = (w->acc << len) | code;
+    w->nbits += len;
+  }
+  else {
+    flushWord(w, (w->acc << (len - spill)) | (code >> spill), ACCBITS / 8);
+    w->acc = code & (((uint64_t)1 << spill) - 1);
+    w->nbits = spill;
+  }
+}
+
+void flushWord(bitWriter *w, uint64_t word, int nbytes)
+{
+  /* writes the top nbytes of word, most significant byte first */
+  int i;
+
+  for (i = 0; i < nbytes; i++) {
+    w->buf[w->pos++] = (word >> (ACCBITS - BITSPERBYTE * (i + 1))) & 0xFF;
+  }
+}
+
+void flushBits(bitWriter *w)
+{
+  /* pads the last partial byte with zeros */
+  if (w->nbits > 0) {
+    flushWord(w, w->acc << (ACCBITS - w->nbits),
+      w->nbits / BITSPERBYTE + (w->nbits % BITSPERBYTE != 0));
+  }
+  w->nbits = 0;
+}
+
+void decodeStreams(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, codeTable *t)
+{
+  /* Decodes len chars from the n bytes at p written by encodeStreams().
+   * Each step takes one char from every stream, and as each stream has
+   * its own reader the NSTREAMS lookups don't wait on one another. */
+  bitReader r[NSTREAMS];
+  decodeTable dt;
+  size_t i, off = STREAMSLEN, slen;
+  int k;
+
+  if (n < STREAMSLEN) {
+    huffError("corrupt block header");
+    fail();
+  }
+  for (k = 0; k < NSTREAMS; k++) {
+    slen = k < NSTREAMS - 1 ? readUint(p + 4 * k, 4) : n - off;
+    if (slen > n - off) {
+      huffError("corrupt block header");
+      fail();
+    }
+    startReader(&r[k], p + off, slen);
+    off += slen;
+  }
+  buildDecodeTable(t, &dt);
+
+  i = decodeWords(r, NSTREAMS, &dt, out, len);
+  for (; i + NSTREAMS <= len; i += NSTREAMS) {
+    for (k = 0; k < NSTREAMS; k++) {
+      if (r[k].nbits < MAXCODELEN) {
+        refillBits(&r[k]);
+      }
+      out[i + k] = decodeSymbol(&r[k], &dt);
+    }
+  }
+  for (k = 0; i < len; i++, k++) {
+    if (r[k].nbits < MAXCODELEN) {
+      refillBits(&r[k]);
+    }
+    out[i] = decodeSymbol(&r[k], &dt);
+  }
+}
+
+size_t decodeWords(bitReader *r, int streams, decodeTable *dt,
+  unsigned char *out, size_t len)
+{
+  /* Decodes as many of the len chars as it can a whole word at a time,
+   * from the one reader r or from NSTREAMS in turn, and returns how many
+   * it did.  The loop for the block's table width and layout is picked
+   * once, here.  The loops don't stop for a bad code, so it is reported
+   * once they have. */
+  decodeLoop loop;
+  size_t i;
+  int bad;
+
+  if (dt->longest > TABLEBITS) {
+    loop = streams == 1 ? decodeRunLong : decodeGroupsLong;
+  }
+  else if (dt->bits == 8) {
+    loop = streams == 1 ? decodeRun8 : decodeGroups8;
+  }
+  else if (dt->bits == 10) {
+    loop = streams == 1 ? decodeRun10 : decodeGroups10;
+  }
+  else if (dt->bits == 11) {
+    loop = streams == 1 ? decodeRun11 : decodeGroups11;
+  }
+  else {
+    loop = streams == 1 ? decodeRun12 : decodeGroups12;
+  }
+  i = loop(r, dt, out, len, &bad);
+
+  if (bad) {
+    huffError("invalid code in compressed data");
+    fail();
+  }
+  return i;
+}
+
+static size_t decodeRun8(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* Decodes GROUP8 chars after each load of a whole word, while the
+   * reader has a word left, and returns how many chars it did, setting
+   * *invalid if any code was bad.  The reader is worked on in a local
+   * copy, and the table width and group are constants, so the lookups
+   * need no checks and can be unrolled. */
+  bitReader s = *r;
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, l;
+
+  for (i = 0; i + GROUP8 <= len && wordsLeft(&s, 1); i += GROUP8) {
+    loadWords(&s, 1);
+    for (j = 0; j < GROUP8; j++) {
+      e = dt->entry[s.acc >> (ACCBITS - 8)];
+      l = e & LENMASK;
+      bad |= l == 0;
+      s.acc <<= l;
+      s.nbits -= l;
+      out[i + j] = e >> ENTRYSHIFT;
+    }
+  }
+  *r = s;
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeRun10(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeRun8(), for a 10 bit table */
+  bitReader s = *r;
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, l;
+
+  for (i = 0; i + GROUP10 <= len && wordsLeft(&s, 1); i += GROUP10) {
+    loadWords(&s, 1);
+    for (j = 0; j < GROUP10; j++) {
+      e = dt->entry[s.acc >> (ACCBITS - 10)];
+      l = e & LENMASK;
+      bad |= l == 0;
+      s.acc <<= l;
+      s.nbits -= l;
+      out[i + j] = e >> ENTRYSHIFT;
+    }
+  }
+  *r = s;
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeRun11(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeRun8(), for an 11 bit table */
+  bitReader s = *r;
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, l;
+
+  for (i = 0; i + GROUP10 <= len && wordsLeft(&s, 1); i += GROUP10) {
+    loadWords(&s, 1);
+    for (j = 0; j < GROUP10; j++) {
+      e = dt->entry[s.acc >> (ACCBITS - 11)];
+      l = e & LENMASK;
+      bad |= l == 0;
+      s.acc <<= l;
+      s.nbits -= l;
+      out[i + j] = e >> ENTRYSHIFT;
+    }
+  }
+  *r = s;
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeRun12(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeRun8(), for a TABLEBITS table with no secondary tables */
+  bitReader s = *r;
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, l;
+
+  for (i = 0; i + GROUP12 <= len && wordsLeft(&s, 1); i += GROUP12) {
+    loadWords(&s, 1);
+    for (j = 0; j < GROUP12; j++) {
+      e = dt->entry[s.acc >> (ACCBITS - TABLEBITS)];
+      l = e & LENMASK;
+      bad |= l == 0;
+      s.acc <<= l;
+      s.nbits -= l;
+      out[i + j] = e >> ENTRYSHIFT;
+    }
+  }
+  *r = s;
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeRunLong(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeRun8(), for a TABLEBITS table, sending longer codes on
+   * to the secondary tables */
+  bitReader s = *r;
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, l;
+
+  for (i = 0; i + DECGROUP <= len && wordsLeft(&s, 1); i += DECGROUP) {
+    loadWords(&s, 1);
+    for (j = 0; j < DECGROUP; j++) {
+      e = dt->entry[s.acc >> (ACCBITS - TABLEBITS)];
+      if (e & LINKFLAG) {
+        s.acc <<= TABLEBITS;
+        s.nbits -= TABLEBITS;
+        e = dt->entry[(e >> ENTRYSHIFT)
+          + (s.acc >> (ACCBITS - (e & LENMASK)))];
+      }
+      l = e & LENMASK;
+      bad |= l == 0;
+      s.acc <<= l;
+      s.nbits -= l;
+      out[i + j] = e >> ENTRYSHIFT;
+    }
+  }
+  *r = s;
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeGroups8(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* As decodeRun8(), from each of the NSTREAMS readers in turn, while
+   * every stream has a word left.  The processor can get on with the
+   * next reader's bits while it waits on this one's table lookups. */
+  bitReader s[NSTREAMS];
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, k, l;
+
+  memcpy(s, r, sizeof(s));
+  for (i = 0; i + GROUP8 * NSTREAMS <= len && wordsLeft(s, NSTREAMS);
+    i += GROUP8 * NSTREAMS) {
+    loadWords(s, NSTREAMS);
+    for (k = 0; k < NSTREAMS; k++) {
+      for (j = 0; j < GROUP8; j++) {
+        e = dt->entry[s[k].acc >> (ACCBITS - 8)];
+        l = e & LENMASK;
+        bad |= l == 0;
+        s[k].acc <<= l;
+        s[k].nbits -= l;
+        out[i + j * NSTREAMS + k] = e >> ENTRYSHIFT;
+      }
+    }
+  }
+  memcpy(r, s, sizeof(s));
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeGroups10(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeGroups8(), for a 10 bit table */
+  bitReader s[NSTREAMS];
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, k, l;
+
+  memcpy(s, r, sizeof(s));
+  for (i = 0; i + GROUP10 * NSTREAMS <= len && wordsLeft(s, NSTREAMS);
+    i += GROUP10 * NSTREAMS) {
+    loadWords(s, NSTREAMS);
+    for (k = 0; k < NSTREAMS; k++) {
+      for (j = 0; j < GROUP10; j++) {
+        e = dt->entry[s[k].acc >> (ACCBITS - 10)];
+        l = e & LENMASK;
+        bad |= l == 0;
+        s[k].acc <<= l;
+        s[k].nbits -= l;
+        out[i + j * NSTREAMS + k] = e >> ENTRYSHIFT;
+      }
+    }
+  }
+  memcpy(r, s, sizeof(s));
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeGroups11(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeGroups8(), for an 11 bit table */
+  bitReader s[NSTREAMS];
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, k, l;
+
+  memcpy(s, r, sizeof(s));
+  for (i = 0; i + GROUP10 * NSTREAMS <= len && wordsLeft(s, NSTREAMS);
+    i += GROUP10 * NSTREAMS) {
+    loadWords(s, NSTREAMS);
+    for (k = 0; k < NSTREAMS; k++) {
+      for (j = 0; j < GROUP10; j++) {
+        e = dt->entry[s[k].acc >> (ACCBITS - 11)];
+        l = e & LENMASK;
+        bad |= l == 0;
+        s[k].acc <<= l;
+        s[k].nbits -= l;
+        out[i + j * NSTREAMS + k] = e >> ENTRYSHIFT;
+      }
+    }
+  }
+  memcpy(r, s, sizeof(s));
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeGroups12(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeGroups8(), for a TABLEBITS table with no secondary tables */
+  bitReader s[NSTREAMS];
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, k, l;
+
+  memcpy(s, r, sizeof(s));
+  for (i = 0; i + GROUP12 * NSTREAMS <= len && wordsLeft(s, NSTREAMS);
+    i += GROUP12 * NSTREAMS) {
+    loadWords(s, NSTREAMS);
+    for (k = 0; k < NSTREAMS; k++) {
+      for (j = 0; j < GROUP12; j++) {
+        e = dt->entry[s[k].acc >> (ACCBITS - TABLEBITS)];
+        l = e & LENMASK;
+        bad |= l == 0;
+        s[k].acc <<= l;
+        s[k].nbits -= l;
+        out[i + j * NSTREAMS + k] = e >> ENTRYSHIFT;
+      }
+    }
+  }
+  memcpy(r, s, sizeof(s));
+  *invalid = bad;
+  return i;
+}
+
+static size_t decodeGroupsLong(bitReader *r, decodeTable *dt,
+  unsigned char *out, size_t len, int *invalid)
+{
+  /* as decodeGroups8(), for a TABLEBITS table, sending longer codes on
+   * to the secondary tables */
+  bitReader s[NSTREAMS];
+  uint32_t e;
+  size_t i;
+  int bad = 0, j, k, l;
+
+  memcpy(s, r, sizeof(s));
+  for (i = 0; i + DECGROUP * NSTREAMS <= len && wordsLeft(s, NSTREAMS);
+    i += DECGROUP * NSTREAMS) {
+    loadWords(s, NSTREAMS);
+    for (k = 0; k < NSTREAMS; k++) {
+      for (j = 0; j < DECGROUP; j++) {
+        e = dt->entry[s[k].acc >> (ACCBITS - TABLEBITS)];
+        if (e & LINKFLAG) {
+          s[k].acc <<= TABLEBITS;
+          s[k].nbits -= TABLEBITS;
+          e = dt->entry[(e >> ENTRYSHIFT)
+            + (s[k].acc >> (ACCBITS - (e & LENMASK)))];
+        }
+        l = e & LENMASK;
+        bad |= l == 0;
+        s[k].acc <<= l;
+        s[k].nbits -= l;
+        out[i + j * NSTREAMS + k] = e >> ENTRYSHIFT;
+      }
+    }
+  }
+  memcpy(r, s, sizeof(s));
+  *invalid = bad;
+  return i;
+}
+
+void decodeBytes(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, codeTable *t)
+{
+  /* decodes len chars from the n byte bitstream at p */
+  decodeTable dt;
+
+  buildDecodeTable(t, &dt);
+  decodeWithTable(p, n, out, len, &dt);
+}
+
+void decodeWithTable(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len, decodeTable *dt)
+{
+  /* likewise with a decode table already built, which isn't changed */
+  bitReader r;
+
+  startReader(&r, p, n);
+  decodeFrom(&r, dt, out, len);
+}
+
+void decodeFrom(bitReader *r, decodeTable *dt, unsigned char *out,
+  size_t len)
+{
+  /* decodes len chars from r, as many as it can a group at a time */
+  size_t i = decodeWords(r, 1, dt, out, len);
+
+  for (; i < len; i++) {
+    if (r->nbits < MAXCODELEN) {
+      refillBits(r);
+    }
+    out[i] = decodeSymbol(r, dt);
+  }
+}
+
+void startReader(bitReader *r, const unsigned char *p, size_t n)
+{
+  r->acc = 0;
+  r->nbits = 0;
+  r->buf = p;
+  r->pos = 0;
+  r->end = n;
+}
+
+void seekReader(bitReader *r, const unsigned char *p, size_t n,
+  uint64_t bitoff)
+{
+  /* starts r bitoff bits into the n byte bitstream at p */
+  if (bitoff / BITSPERBYTE > n) {
+    huffError("corrupt seek table");
+    fail();
+  }
+  startReader(r, p + bitoff / BITSPERBYTE, n - bitoff / BITSPERBYTE);
+  if (bitoff % BITSPERBYTE != 0) {
+    refillBits(r);
+    if (r->nbits < (int)(bitoff % BITSPERBYTE)) {
+      huffError("compressed data is truncated");
+      fail();
+    }
+    r->acc <<= bitoff % BITSPERBYTE;
+    r->nbits -= bitoff % BITSPERBYTE;
+  }
+}
+
+void refillBits(bitReader *r)
+{
+  /* a whole word if there is one, otherwise the accumulator is topped
+   * up a byte at a time, until the end of the bitstream */
+  if (wordsLeft(r, 1)) {
+    loadWords(r, 1);
+    return;
+  }
+  while (r->nbits <= ACCBITS - BITSPERBYTE && r->pos < r->end) {
+    r->acc |= (uint64_t)r->buf[r->pos++] << (ACCBITS - BITSPERBYTE - r->nbits);
+    r->nbits += BITSPERBYTE;
+  }
+}
+
+static void loadWords(bitReader *r, int streams)
+{
+  /* Loads the next 8 bytes of each of the streams readers at r as one
+   * word, and keeps as many whole bytes as fit, with no branches, which
+   * leaves at least ACCBITS - BITSPERBYTE bits.  Any bits of a byte past
+   * nbits are loaded again, unchanged, next time.  Each needs a word
+   * left, as wordsLeft() checks. */
+  const unsigned char *p;
+  int k;
+
+  for (k = 0; k < streams; k++) {
+    p = r[k].buf + r[k].pos;
+    r[k].acc |= ((uint64_t)p[0] << 56 | (uint64_t)p[1] << 48
+      | (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32
+      | (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16
+      | (uint64_t)p[6] << 8 | (uint64_t)p[7]) >> r[k].nbits;
+    r[k].pos += (ACCBITS - 1 - r[k].nbits) / BITSPERBYTE;
+    r[k].nbits |= ACCBITS - BITSPERBYTE;
+  }
+}
+
+static int wordsLeft(bitReader *r, int streams)
+{
+  /* 1 if each of the streams readers at r has a whole word left */
+  int k;
+
+  for (k = 0; k < streams; k++) {
+    if (r[k].pos + ACCBITS / BITSPERBYTE > r[k].end) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void buildDecodeTable(codeTable *t, decodeTable *dt)
+{
+  /* The table is as wide as the longest code, rounded up to 8, 10, 11
+   * or TABLEBITS bits, so a block of short codes gets a small table.  A
+   * code of length l <= bits fills every entry that starts with it.  A
+   * longer code's first bits pick an entry that links to a secondary
+   * table, sized for the longest code sharing those bits, which is
+   * filled in the same way with the rest of the code. */
+  int i, l, p, b, extra, next;
+  int sub[1 << TABLEBITS] = {0};
+  uint32_t e;
+
+  memset(dt, 0, sizeof(decodeTable));
+  for (i = 0; i < ASIZE; i++) {
+    if (t->len[i] > dt->longest) {
+      dt->longest = t->len[i];
+    }
+  }
+  b = dt->bits = dt->longest <= 8 ? 8 : dt->longest <= 10 ? 10
+    : dt->longest <= 11 ? 11 : TABLEBITS;
+
+  for (i = 0; i < ASIZE; i++) {
+    l = t->len[i];
+    if (l > b) {
+      p = t->code[i] >> (l - b);
+      if (l - b > sub[p]) {
+        sub[p] = l - b;
+      }
+    }
+  }
+  for (p = 0, next = 1 << b; p < 1 << b; p++) {
+    if (sub[p] != 0) {
+      dt->entry[p] = ((uint32_t)next << ENTRYSHIFT) | LINKFLAG | sub[p];
+      next += 1 << sub[p];
+    }
+  }
+
+  for (i = 0; i < ASIZE; i++) {
+    l = t->len[i];
+    if (l == 0) {
+      continue;
+    }
+    if (l <= b) {
+      fillEntries(dt->entry + (t->code[i] << (b - l)),
+        1 << (b - l), ((uint32_t)i << ENTRYSHIFT) | l);
+    }
+    else {
+      extra = l - b;
+      e = dt->entry[t->code[i] >> extra];
+      p = (t->code[i] & ((1 << extra) - 1)) << ((e & LENMASK) - extra);
+      fillEntries(dt->entry + (e >> ENTRYSHIFT) + p,
+        1 << ((e & LENMASK) - extra), ((uint32_t)i << ENTRYSHIFT) | extra);
+    }
+  }
+}
+
+void fillEntries(uint32_t *e, int n, uint32_t value)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    e[i] = value;
+  }
+}
+
+int decodeSymbol(bitReader *r, decodeTable *dt)
+{
+  /* Needs at least MAXCODELEN bits in the accumulator */
+  uint32_t e = dt->entry[r->acc >> (ACCBITS - dt->bits)];
+  int l;
+
+  if (e & LINKFLAG) {
+    r->acc <<= dt->bits;
+    r->nbits -= dt->bits;
+    e = dt->entry[(e >> ENTRYSHIFT) + (r->acc >> (ACCBITS - (e & LENMASK)))];
+  }
+  l = e & LENMASK;
+  if (l == 0) {
+    huffError("invalid code in compressed data");
+    fail();
+  }
+  r->acc <<= l;
+  r->nbits -= l;
+  if (r->nbits < 0) {
+    huffError("compressed data is truncated");
+    fail();
+  }
+  return e >> ENTRYSHIFT;
+}
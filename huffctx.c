@@ -0,0 +1,299 @@
+/* huffctx.c
+ *
+ * Part of libhuff (see huff.h): codes a block with order-1 contexts,
+ * where the code table used for each char is picked by the char before
+ * it, so that 'u' is cheap after 'q' without costing more elsewhere.
+ *
+ * A table for every one of the ASIZE contexts would cost more to send
+ * than it saves, so similar contexts share one of at most CTXTABLES
+ * tables.  The contexts are clustered by the bits their chars would take
+ * with each table: starting from one table for the whole block, the
+ * context that suffers most from sharing gets a table of its own, then
+ * each context moves to whichever table codes it in the fewest bits and
+ * the tables are rebuilt from their contexts, for CTXROUNDS rounds.
+ * Tables are added this way until one more would not make the block
+ * smaller.  Ties go to the lowest context or table, so the same block
+ * always clusters the same way.
+ *
+ * A BLOCKCTX block has, after the usual block header, the number of
+ * tables, the table of each context in a nibble, then the code length
+ * nibbles of each table, and the bitstream.  The first char is coded with
+ * the table of context 0.  Decoding is by the usual table lookups, one
+ * decode table for each code table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+#define CTXROUNDS 4 /* rounds of moving contexts after each new table */
+#define CTXMAPLEN (ASIZE / 2) /* bytes of table nibbles, by context */
+#define NOCOST ((uint64_t)-1) /* cost of a context a table can't code */
+
+size_t encodeContextBlock(const unsigned char *p, size_t n, int maxcodelen,
+  size_t limit, unsigned char *out)
+{
+  /* Writes p as a BLOCKCTX block and returns its length, or returns 0
+   * without writing if it would come to limit bytes or more. */
+  uint64_t *h = (uint64_t *)allocMem(ASIZE * ASIZE * sizeof(uint64_t));
+  codeTable t[CTXTABLES];
+  unsigned char map[ASIZE];
+  uint64_t bits;
+  size_t i, size;
+  bitWriter w;
+  int k, prev;
+
+  countContexts(p, n, h);
+  k = clusterContexts(h, maxcodelen, map, t, &bits);
+  size = BLOCKHDRLEN + 1 + CTXMAPLEN + k * LENGTHSLEN
+    + (bits + BITSPERBYTE - 1) / BITSPERBYTE;
+  freeMem(h);
+  if (size >= limit) {
+    return 0;
+  }
+
+  out[0] = BLOCKCTX;
+  writeUint(out + 1, n, 4);
+  writeUint(out + 5, size - BLOCKHDRLEN, 4);
+  out[BLOCKHDRLEN] = k;
+  for (i = 0; i < ASIZE; i += 2) {
+    out[BLOCKHDRLEN + 1 + i / 2] = map[i] | (map[i + 1] << 4);
+  }
+  for (i = 0; i < (size_t)k; i++) {
+    writeLengths(out + BLOCKHDRLEN + 1 + CTXMAPLEN + i * LENGTHSLEN, &t[i]);
+  }
+
+  w.acc = 0;
+  w.nbits = 0;
+  w.buf = out + BLOCKHDRLEN + 1 + CTXMAPLEN + k * LENGTHSLEN;
+  w.pos = 0;
+  for (i = 0, prev = 0; i < n; prev = p[i++]) {
+    putBits(&w, t[map[prev]].code[p[i]], t[map[prev]].len[p[i]]);
+  }
+  flushBits(&w);
+  return size;
+}
+
+void decodeContextBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len)
+{
+  /* Decodes the BLOCKCTX block of n bytes at p, after its header, into
+   * the len bytes at out */
+  decodeContexts(p, n, 0, 0, out, len);
+}
+
+size_t readContextTables(const unsigned char *p, size_t n, 
+  unsigned char *map, codeTable *t, int *k)
+{
+  /* Reads the table of each context and the *k tables from the BLOCKCTX
+   * block of n bytes at p, and returns where its bitstream starts */
+  size_t i, pos = BLOCKHDRLEN + 1 + CTXMAPLEN;
+  int j;
+
+  if (n < pos || (*k = p[BLOCKHDRLEN]) < 1 || *k > CTXTABLES
+    || n < pos + *k * LENGTHSLEN) {
+    huffError("corrupt context tables");
+    fail();
+  }
+  for (i = 0; i < ASIZE; i++) {
+    map[i] = i % 2 == 0 ? p[BLOCKHDRLEN + 1 + i / 2] & 0xF
+      : p[BLOCKHDRLEN + 1 + i / 2] >> 4;
+    if (map[i] >= *k) {
+      huffError("corrupt context tables");
+      fail();
+    }
+  }
+  for (j = 0; j < *k; j++) {
+    readLengths(p + pos, &t[j]);
+    assignCanonicalCodes(&t[j]);
+    pos += LENGTHSLEN;
+  }
+  return pos;
+}
+
+void decodeContexts(const unsigned char *p, size_t n, uint64_t bitoff, 
+  int prev, unsigned char *out, size_t count)
+{
+  /* Decodes count chars of the BLOCKCTX block of n bytes at p, whose
+   * code starts bitoff bits into the bitstream, after the char prev */
+  codeTable t[CTXTABLES];
+  unsigned char map[ASIZE];
+  decodeTable *dt;
+  size_t i, pos;
+  bitReader r;
+  int k = 0, j;
+
+  pos = readContextTables(p, n, map, t, &k);
+  dt = (decodeTable *)allocMem(k * sizeof(decodeTable));
+  for (j = 0; j < k; j++) {
+    buildDecodeTable(&t[j], &dt[j]);
+  }
+
+  seekReader(&r, p + pos, n - pos, bitoff);
+  for (i = 0; i < count; i++) {
+    if (r.nbits < MAXCODELEN) {
+      refillBits(&r);
+    }
+    out[i] = prev = decodeSymbol(&r, &dt[map[prev]]);
+  }
+  freeMem(dt);
+}
+
+void countContexts(const unsigned char *p, size_t n, uint64_t *h)
+{
+  /* h[a * ASIZE + b] is the number of times b follows a, with the first
+   * char following 0 */
+  size_t i;
+  int prev = 0;
+
+  memset(h, 0, ASIZE * ASIZE * sizeof(uint64_t));
+  for (i = 0; i < n; prev = p[i++]) {
+    h[prev * ASIZE + p[i]]++;
+  }
+}
+
+int clusterContexts(uint64_t *h, int maxcodelen, unsigned char *map,
+  codeTable *t, uint64_t *bits)
+{
+  /* Fills in the table of every context and the k tables, and returns
+   * k, with the bits the block's codes take in bits.  Only the contexts
+   * that occur are moved, and a round that would leave a table with none
+   * of them stops adding tables too. */
+  unsigned char best[ASIZE];
+  codeTable saved[CTXTABLES], own;
+  uint64_t alone[ASIZE], freqs[ASIZE], cost, least, worst, size, bestsize;
+  int used[ASIZE], nused = 0, k, i, j, c, r, seed;
+
+  /* what each context would take with a table of its own */
+  for (c = 0; c < ASIZE; c++) {
+    memcpy(freqs, h + c * ASIZE, sizeof(freqs));
+    for (i = 0; i < ASIZE && freqs[i] == 0; i++) {
+      ;
+    }
+    if (i < ASIZE) {
+      used[nused++] = c;
+      padFreqs(freqs);
+      buildCodes(freqs, maxcodelen, &own);
+      alone[c] = contextCost(h + c * ASIZE, &own);
+    }
+  }
+
+  memset(map, 0, ASIZE);
+  buildContextTables(h, map, 1, maxcodelen, t);
+  bestsize = contextBits(h, map, t) + BITSPERBYTE * LENGTHSLEN;
+  memcpy(best, map, ASIZE);
+  saved[0] = t[0];
+
+  for (k = 1; k < CTXTABLES; k++) {
+    /* the new table's seed is the context that loses most by sharing */
+    seed = -1;
+    worst = 0;
+    for (i = 0; i < nused; i++) {
+      c = used[i];
+      cost = contextCost(h + c * ASIZE, &t[map[c]]);
+      if (cost > alone[c] && cost - alone[c] > worst) {
+        worst = cost - alone[c];
+        seed = c;
+      }
+    }
+    if (seed < 0) {
+      break;
+    }
+    map[seed] = k;
+
+    for (r = 0; r < CTXROUNDS; r++) {
+      if (!buildContextTables(h, map, k + 1, maxcodelen, t)) {
+        break;
+      }
+      for (i = 0; i < nused; i++) {
+        c = used[i];
+        least = contextCost(h + c * ASIZE, &t[map[c]]);
+        for (j = 0; j <= k; j++) {
+          cost = contextCost(h + c * ASIZE, &t[j]);
+          if (cost < least) {
+            least = cost;
+            map[c] = j;
+          }
+        }
+      }
+    }
+    if (r < CTXROUNDS || !buildContextTables(h, map, k + 1, maxcodelen, t)) {
+      break;
+    }
+
+    size = contextBits(h, map, t) + (uint64_t)BITSPERBYTE * LENGTHSLEN
+      * (k + 1);
+    if (size >= bestsize) {
+      break;
+    }
+    bestsize = size;
+    memcpy(best, map, ASIZE);
+    for (j = 0; j <= k; j++) {
+      saved[j] = t[j];
+    }
+  }
+
+  memcpy(map, best, ASIZE);
+  for (j = 0; j < k; j++) {
+    t[j] = saved[j];
+  }
+  *bits = contextBits(h, map, t);
+  return k;
+}
+
+int buildContextTables(uint64_t *h, unsigned char *map, int k,
+  int maxcodelen, codeTable *t)
+{
+  /* builds the k tables from the counts of their contexts, and returns
+   * 0 if one of them has none */
+  uint64_t freqs[CTXTABLES][ASIZE];
+  uint64_t total[CTXTABLES] = {0};
+  int a, b, j;
+
+  memset(freqs, 0, sizeof(freqs));
+  for (a = 0; a < ASIZE; a++) {
+    for (b = 0; b < ASIZE; b++) {
+      freqs[map[a]][b] += h[a * ASIZE + b];
+      total[map[a]] += h[a * ASIZE + b];
+    }
+  }
+  for (j = 0; j < k; j++) {
+    if (total[j] == 0) {
+      return 0;
+    }
+    padFreqs(freqs[j]);
+    buildCodes(freqs[j], maxcodelen, &t[j]);
+  }
+  return 1;
+}
+
+uint64_t contextCost(uint64_t *h, codeTable *t)
+{
+  /* the bits the chars of one context take with t, or NOCOST if t has
+   * no code for one of them */
+  uint64_t bits = 0;
+  int b;
+
+  for (b = 0; b < ASIZE; b++) {
+    if (h[b] != 0) {
+      if (t->len[b] == 0) {
+        return NOCOST;
+      }
+      bits += h[b] * t->len[b];
+    }
+  }
+  return bits;
+}
+
+uint64_t contextBits(uint64_t *h, unsigned char *map, codeTable *t)
+{
+  uint64_t bits = 0;
+  int a;
+
+  for (a = 0; a < ASIZE; a++) {
+    bits += contextCost(h + a * ASIZE, &t[map[a]]);
+  }
+  return bits;
+}
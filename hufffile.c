@@ -0,0 +1,905 @@
+/* hufffile.c
+ * 
+ * Part of libhuff (see huff.h): reads and writes whole compressed files,
+ * from a mapped input file or as a stream.
+ *
+ * Compressed files start with a small header: the magic "HUF", a format
+ * version byte and the block size.  The input is compressed in blocks of
+ * that many bytes, independently, so each has a code fitted to its own
+ * part of the file, and blocks can be compressed and decompressed on a
+ * pool of threads.  The file ends with an end block indexing where every
+ * block starts, both compressed and uncompressed, so any block can be
+ * found without reading the ones before it, and a seek table can come
+ * before it (see huffseek.c).  Files compressed with
+ * adaptive codes or a shared table have no blocks, and are handed to
+ * huffadapt.c and hufftable.c.
+ *
+ * Every error in libhuff is reported on stderr and ends in fail(), which
+ * exits, unless the thread has set up a huffCatch to jump back to.  So
+ * one process can work through many files and carry on past those that
+ * fail.  Memory from allocMem(), the files from openFile() and the input
+ * from openInput() are tracked while it is set up, so that a failed
+ * call leaves nothing behind.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for mmap() and friends */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "huff.h"
+
+#define IOBUFSIZE 65536 /* first size of the buffer for unmappable input */
+
+void compressFile(char *inname, char *outname, huffParams *hp)
+{
+  /* The input is cut into blocks of hp->blocksize bytes, which are
+   * compressed independently, each with a code built from its own
+   * counts, and written out in order after the file header.  An end
+   * block holding the index of where every block starts comes last,
+   * after the seek table if there is one. */
+  blockJob job;
+  inputFile in;
+  FILE *out;
+  size_t nseek = 0;
+  int i;
+
+  if (hp->seek != 0 && (hp->seek % 2 != 0 || hp->streams != 1 
+    || hp->adaptive || hp->table != NULL || strcmp(inname, "-") == 0)) {
+    huffError("a seek table needs an even interval, and a"
+      " file compressed in uninterleaved blocks");
+    fail();
+  }
+  if (hp->adaptive) {
+    compressAdaptiveFile(inname, outname);
+    return;
+  }
+  if (hp->table != NULL) {
+    compressTableFile(inname, outname, hp->table);
+    return;
+  }
+  if (strcmp(inname, "-") == 0) {
+    out = openFile(outname, "wb");
+    compressStream(stdin, out, hp);
+    closeFile(out, outname);
+    return;
+  }
+  openInput(inname, &in);
+  if (in.len / hp->blocksize >= MAXBLOCKS) {
+    huffError("too many blocks - use a larger block size");
+    fail();
+  }
+  job.nblocks = (in.len + hp->blocksize - 1) / hp->blocksize;
+  job.in = in.data;
+  job.inoff = (uint64_t *)allocMem((job.nblocks + 1) * sizeof(uint64_t));
+  job.outoff = (uint64_t *)allocMem((job.nblocks + 1) * sizeof(uint64_t));
+  job.rawoff = NULL;
+  for (i = 0; i < job.nblocks; i++) {
+    job.inoff[i] = (uint64_t)i * hp->blocksize;
+  }
+  job.inoff[job.nblocks] = in.len;
+  job.outoff[0] = FILEHDRLEN;
+  job.maxcodelen = hp->maxcodelen;
+  job.streams = hp->streams;
+  job.pairs = hp->pairs;
+  job.context = hp->context;
+  job.threads = hp->threads;
+  /* a file smaller than a block only needs room for itself */
+  job.bufsize = maxBlockBytes(in.len < hp->blocksize ? in.len 
+    : hp->blocksize);
+  job.work = compressBlock;
+  job.seek = hp->seek;
+  job.seektab = NULL;
+  if (hp->seek != 0) {
+    for (i = 0; i < job.nblocks; i++) {
+      nseek += seekEntries(job.inoff[i + 1] - job.inoff[i], hp->seek);
+    }
+    job.seektab = (unsigned char *)allocMem(nseek * SEEKENTRY + 1);
+  }
+
+  out = openFile(outname, "wb");
+  writeHeader(out, hp->blocksize);
+  runBlocks(&job, out);
+  if (hp->seek != 0) {
+    writeSeekTable(out, job.seektab, nseek * SEEKENTRY, hp->seek);
+  }
+  writeIndex(out, job.nblocks, job.outoff, job.inoff, 
+    hp->seek != 0 ? BLOCKHDRLEN + nseek * SEEKENTRY : 0);
+
+  closeInput(&in);
+  freeMem(job.inoff);
+  freeMem(job.outoff);
+  freeMem(job.seektab);
+  closeFile(out, outname);
+}
+
+void decompressFile(char *inname, char *outname, huffParams *hp)
+{
+  /* The index gives the span of every block in the compressed file,
+   * so the blocks can be decoded in any order, and in parallel. */
+  blockJob job;
+  inputFile in;
+  FILE *out;
+  size_t blocksize;
+
+  if (strcmp(inname, "-") == 0 && hp->table == NULL) {
+    out = openFile(outname, "wb");
+    decompressStream(stdin, out, hp->threads);
+    closeFile(out, outname);
+    return;
+  }
+  openInput(inname, &in);
+  if (in.len >= ADAPTHDRLEN && memcmp(in.data, MAGIC, MAGICLEN) == 0
+    && in.data[MAGICLEN] == ADAPTVERSION) {
+    decompressAdaptiveFile(&in, outname);
+    return;
+  }
+  if (in.len >= ADAPTHDRLEN && memcmp(in.data, MAGIC, MAGICLEN) == 0
+    && in.data[MAGICLEN] == TABLEDVERSION) {
+    if (hp->table == NULL) {
+      huffError("%s was coded with a table - give it with"
+        " --table", inname);
+      fail();
+    }
+    decompressTableFile(&in, outname, hp->table);
+    return;
+  }
+  blocksize = readHeader(in.data, in.len);
+  job.nblocks = readIndex(&in, blocksize, &job.inoff, &job.rawoff);
+  job.in = in.data;
+  job.outoff = (uint64_t *)allocMem((job.nblocks + 1) * sizeof(uint64_t));
+  job.outoff[0] = 0;
+  job.maxcodelen = 0;
+  job.streams = 1;
+  job.pairs = 0;
+  job.context = 0;
+  job.threads = hp->threads;
+  job.bufsize = job.rawoff[job.nblocks] < blocksize 
+    ? job.rawoff[job.nblocks] : blocksize;
+  job.work = decompressBlock;
+
+  out = openFile(outname, "wb");
+  runBlocks(&job, out);
+
+  closeInput(&in);
+  freeMem(job.inoff);
+  freeMem(job.rawoff);
+  freeMem(job.outoff);
+  closeFile(out, outname);
+}
+
+void compressAdaptiveFile(char *inname, char *outname)
+{
+  FILE *in = openFile(inname, "rb");
+  FILE *out = openFile(outname, "wb");
+
+  compressAdaptive(in, out);
+  closeFile(in, inname);
+  closeFile(out, outname);
+}
+
+void decompressAdaptiveFile(inputFile *in, char *outname)
+{
+  /* decodes the mapped adaptive file in, after its header, and closes it */
+  FILE *out = openFile(outname, "wb");
+  bitReader r;
+
+  startReader(&r, in->data + ADAPTHDRLEN, in->len - ADAPTHDRLEN);
+  decodeAdaptive(&r, NULL, out);
+  closeInput(in);
+  closeFile(out, outname);
+}
+
+void runBlocks(blockJob *job, FILE *out)
+{
+  /* Blocks are handed out in order to a pool of threads, which each
+   * work into one of a small window of output slots.  This thread
+   * writes the slots out in block order as they are finished, so only
+   * the window is ever held in memory, and the pool waits while it is
+   * full.  With one thread, or if none can be started, the blocks are
+   * just worked on here. */
+  pthread_t tid[MAXTHREADS];
+  int i, b, started = 0;
+  blockSlot *s;
+
+  job->window = 2 * job->threads;
+  if (job->window > job->nblocks) {
+    job->window = job->nblocks > 0 ? job->nblocks : 1;
+  }
+  job->slots = (blockSlot *)allocMem(job->window * sizeof(blockSlot));
+  for (i = 0; i < job->window; i++) {
+    job->slots[i].buf = (unsigned char *)allocMem(job->bufsize);
+    job->slots[i].ready = 0;
+  }
+  job->next = job->done = 0;
+  pthread_mutex_init(&job->lock, NULL);
+  pthread_cond_init(&job->cond, NULL);
+  for (i = 0; job->threads > 1 && i < job->threads && i < job->nblocks;
+    i++) {
+    if (pthread_create(&tid[started], NULL, blockWorker, job) == 0) {
+      started++;
+    }
+  }
+
+  for (b = 0; b < job->nblocks; b++) {
+    s = &job->slots[b % job->window];
+    if (started == 0) {
+      job->work(job, b, s);
+    }
+    pthread_mutex_lock(&job->lock);
+    while (started > 0 && !s->ready) {
+      pthread_cond_wait(&job->cond, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    if (fwrite(s->buf, 1, s->len, out) != s->len) {
+      huffError("failed to write output");
+      fail();
+    }
+    job->outoff[b + 1] = job->outoff[b] + s->len;
+
+    pthread_mutex_lock(&job->lock);
+    s->ready = 0;
+    job->done++;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  for (i = 0; i < started; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  pthread_mutex_destroy(&job->lock);
+  pthread_cond_destroy(&job->cond);
+  for (i = 0; i < job->window; i++) {
+    freeMem(job->slots[i].buf);
+  }
+  freeMem(job->slots);
+}
+
+void *blockWorker(void *arg)
+{
+  /* Takes the next block whose slot has been written out, until there
+   * are no blocks left */
+  blockJob *job = (blockJob *)arg;
+  blockSlot *s;
+  int b;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    while (job->next < job->nblocks && job->next >= job->done + job->window) {
+      pthread_cond_wait(&job->cond, &job->lock);
+    }
+    if (job->next == job->nblocks) {
+      pthread_mutex_unlock(&job->lock);
+      return NULL;
+    }
+    b = job->next++;
+    pthread_mutex_unlock(&job->lock);
+
+    s = &job->slots[b % job->window];
+    job->work(job, b, s);
+
+    pthread_mutex_lock(&job->lock);
+    s->ready = 1;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+  }
+}
+
+void compressBlock(blockJob *job, int b, blockSlot *s)
+{
+  s->len = encodeBlock(job->in + job->inoff[b],
+    job->inoff[b + 1] - job->inoff[b], job->maxcodelen, job->streams, 
+    job->pairs, job->context, s->buf);
+  /* every block but the last is full, so block b's entries come after
+   * the same number for each block before it */
+  if (job->seek != 0) {
+    seekPoints(s->buf, s->len, job->in + job->inoff[b],
+      job->inoff[b + 1] - job->inoff[b], job->seek, job->seektab 
+      + b * seekEntries(job->inoff[1], job->seek) * SEEKENTRY);
+  }
+}
+
+void decompressBlock(blockJob *job, int b, blockSlot *s)
+{
+  s->len = decodeBlock(job->in + job->inoff[b],
+    job->inoff[b + 1] - job->inoff[b], s->buf, job->bufsize);
+  if (s->len != job->rawoff[b + 1] - job->rawoff[b]) {
+    huffError("block %d doesn't match the index", b);
+    fail();
+  }
+}
+
+void writeHeader(FILE *out, size_t blocksize)
+{
+  unsigned char hdr[FILEHDRLEN];
+
+  memcpy(hdr, MAGIC, MAGICLEN);
+  hdr[MAGICLEN] = FORMATVERSION;
+  writeUint(hdr + MAGICLEN + 1, blocksize, 4);
+  fwrite(hdr, 1, FILEHDRLEN, out);
+}
+
+size_t readHeader(const unsigned char *p, size_t n)
+{
+  /* checks the n byte file header at p, and returns the block size */
+  size_t blocksize;
+
+  if (n < FILEHDRLEN || memcmp(p, MAGIC, MAGICLEN) != 0) {
+    huffError("not a compressed file");
+    fail();
+  }
+  if (p[MAGICLEN] != FORMATVERSION) {
+    huffError("unsupported format version");
+    fail();
+  }
+  blocksize = readUint(p + MAGICLEN + 1, 4);
+  if (blocksize < MINBLOCKSIZE || blocksize > MAXBLOCKSIZE) {
+    huffError("corrupt file header");
+    fail();
+  }
+  return blocksize;
+}
+
+void writeIndex(FILE *out, int nblocks, uint64_t *coff, uint64_t *roff,
+  size_t seeklen)
+{
+  /* The end block holds the compressed and uncompressed offset of each
+   * block, then the total uncompressed length, roff[nblocks], and the
+   * block count, so a reader can find the index from the end of the
+   * file.  The length of the seek table before it, if any, is in place
+   * of the raw length. */
+  size_t len = nblocks * INDEXENTRY + TRAILERLEN;
+  unsigned char *p = (unsigned char *)allocMem(BLOCKHDRLEN + len);
+  int i;
+
+  p[0] = BLOCKEND;
+  writeUint(p + 1, seeklen, 4);
+  writeUint(p + 5, len, 4);
+  for (i = 0; i < nblocks; i++) {
+    writeUint(p + BLOCKHDRLEN + i * INDEXENTRY, coff[i], 8);
+    writeUint(p + BLOCKHDRLEN + i * INDEXENTRY + 8, roff[i], 8);
+  }
+  writeUint(p + BLOCKHDRLEN + len - TRAILERLEN, roff[nblocks], 8);
+  writeUint(p + BLOCKHDRLEN + len - 8, nblocks, 8);
+  if (fwrite(p, 1, BLOCKHDRLEN + len, out) != BLOCKHDRLEN + len) {
+    huffError("failed to write output");
+    fail();
+  }
+  freeMem(p);
+}
+
+int readIndex(inputFile *f, size_t blocksize, uint64_t **coff, 
+  uint64_t **roff)
+{
+  /* Reads the index at the end of the file into nblocks + 1 compressed
+   * and uncompressed offsets, so the last gives the end of the last
+   * block, before any seek table, and checks that the blocks follow on
+   * from each other. */
+  const unsigned char *p;
+  uint64_t nblocks, end, seeklen;
+  int i;
+
+  if (f->len < FILEHDRLEN + BLOCKHDRLEN + TRAILERLEN) {
+    huffError("compressed file is truncated");
+    fail();
+  }
+  nblocks = readUint(f->data + f->len - 8, 8);
+  if (nblocks >= MAXBLOCKS || nblocks * INDEXENTRY 
+    > f->len - FILEHDRLEN - BLOCKHDRLEN - TRAILERLEN) {
+    huffError("corrupt block index");
+    fail();
+  }
+  end = f->len - TRAILERLEN - nblocks * INDEXENTRY - BLOCKHDRLEN;
+  p = f->data + end;
+  seeklen = readUint(p + 1, 4);
+  if (p[0] != BLOCKEND 
+    || readUint(p + 5, 4) != nblocks * INDEXENTRY + TRAILERLEN
+    || seeklen > end - FILEHDRLEN) {
+    huffError("corrupt block index");
+    fail();
+  }
+
+  *coff = (uint64_t *)allocMem((nblocks + 1) * sizeof(uint64_t));
+  *roff = (uint64_t *)allocMem((nblocks + 1) * sizeof(uint64_t));
+  for (i = 0; i < (int)nblocks; i++) {
+    (*coff)[i] = readUint(p + BLOCKHDRLEN + i * INDEXENTRY, 8);
+    (*roff)[i] = readUint(p + BLOCKHDRLEN + i * INDEXENTRY + 8, 8);
+  }
+  (*coff)[nblocks] = end - seeklen;
+  (*roff)[nblocks] = readUint(f->data + f->len - TRAILERLEN, 8);
+
+  for (i = 0; i < (int)nblocks; i++) {
+    if ((*coff)[i + 1] < (*coff)[i] + BLOCKHDRLEN
+      || (*roff)[i + 1] <= (*roff)[i]
+      || (*roff)[i + 1] - (*roff)[i] > blocksize) {
+      huffError("corrupt block index");
+      fail();
+    }
+  }
+  if ((*coff)[0] != FILEHDRLEN || (*roff)[0] != 0) {
+    huffError("corrupt block index");
+    fail();
+  }
+  return nblocks;
+}
+
+void compressStream(FILE *in, FILE *out, huffParams *hp)
+{
+  /* Input that can only be read once, such as a pipe, is compressed a
+   * block at a time as it arrives, in the same format as a file, through
+   * the pipeline in huffpipe.c.  Memory use is its 2 * threads + 2 slots,
+   * each a block of input and a block of output, plus the index; the
+   * stream's own buffers are never needed, so never allocated. */
+  huffStream s;
+  pipeJob job;
+
+  huff_stream_init(&s, out, hp->blocksize, hp->maxcodelen, hp->streams,
+    hp->pairs, hp->context);
+  job.in = in;
+  job.out = out;
+  job.stream = &s;
+  job.insize = hp->blocksize;
+  job.outsize = maxBlockBytes(hp->blocksize);
+  job.threads = hp->threads;
+  job.read = readRawBlock;
+  job.work = encodeSlot;
+  job.write = writeCodedBlock;
+  runPipe(&job);
+  huff_stream_finish(&s);
+}
+
+void decompressStream(FILE *in, FILE *out, int threads)
+{
+  /* Decodes blocks in order as they arrive, through the pipeline in
+   * huffpipe.c, stopping at the end block.  The index isn't needed, so
+   * it is never read.  An adaptive stream is told apart by its shorter
+   * header. */
+  unsigned char hdr[FILEHDRLEN];
+  size_t blocksize;
+  pipeJob job;
+
+  readBytes(in, hdr, ADAPTHDRLEN);
+  if (memcmp(hdr, MAGIC, MAGICLEN) == 0 && hdr[MAGICLEN] == ADAPTVERSION) {
+    huff_adapt_decode(in, out);
+    return;
+  }
+  readBytes(in, hdr + ADAPTHDRLEN, FILEHDRLEN - ADAPTHDRLEN);
+  blocksize = readHeader(hdr, FILEHDRLEN);
+  job.insize = maxBlockBytes(blocksize);
+  job.outsize = blocksize;
+  job.in = in;
+  job.out = out;
+  job.stream = NULL;
+  job.threads = threads;
+  job.read = readCodedBlock;
+  job.work = decodeSlot;
+  job.write = writeRawBlock;
+  runPipe(&job);
+}
+
+void huff_stream_init(huffStream *s, FILE *out, size_t blocksize, 
+  int maxcodelen, int streams, int pairs, int context)
+{
+  /* Starts a compressed stream on out.  Memory use is a block of input
+   * and a block of output, whatever the length of the stream, plus 16
+   * bytes of index for each block written.  The two blocks are only
+   * allocated once huff_stream_write() needs them. */
+  s->out = out;
+  s->blocksize = blocksize;
+  s->maxcodelen = maxcodelen;
+  s->streams = streams;
+  s->pairs = pairs;
+  s->context = context;
+  s->in = s->buf = NULL;
+  s->inlen = 0;
+  s->cap = 1;
+  s->coff = (uint64_t *)allocMem(s->cap * sizeof(uint64_t));
+  s->roff = (uint64_t *)allocMem(s->cap * sizeof(uint64_t));
+  s->nblocks = 0;
+  s->coff[0] = FILEHDRLEN;
+  s->roff[0] = 0;
+  writeHeader(out, blocksize);
+}
+
+void huff_stream_write(huffStream *s, const void *data, size_t n)
+{
+  /* Adds n bytes to the stream, writing out each block as it fills.
+   * Whole blocks are compressed straight from data, without copying. */
+  const unsigned char *p = (const unsigned char *)data;
+  size_t k;
+
+  while (n > 0) {
+    if (s->inlen == 0 && n >= s->blocksize) {
+      streamBlock(s, p, s->blocksize);
+      k = s->blocksize;
+    }
+    else {
+      if (s->in == NULL) {
+        s->in = (unsigned char *)allocMem(s->blocksize);
+      }
+      k = s->blocksize - s->inlen < n ? s->blocksize - s->inlen : n;
+      memcpy(s->in + s->inlen, p, k);
+      s->inlen += k;
+      if (s->inlen == s->blocksize) {
+        streamBlock(s, s->in, s->inlen);
+        s->inlen = 0;
+      }
+    }
+    p += k;
+    n -= k;
+  }
+}
+
+void huff_stream_flush(huffStream *s)
+{
+  /* Writes out whatever has been added so far, as a short block if
+   * need be, so the reader can decode everything up to here. */
+  if (s->inlen > 0) {
+    streamBlock(s, s->in, s->inlen);
+    s->inlen = 0;
+  }
+  if (fflush(s->out) != 0) {
+    huffError("failed to write output");
+    fail();
+  }
+}
+
+void huff_stream_finish(huffStream *s)
+{
+  /* flushes the stream, ends it with the index, and frees it */
+  huff_stream_flush(s);
+  writeIndex(s->out, s->nblocks, s->coff, s->roff, 0);
+  freeMem(s->in);
+  freeMem(s->buf);
+  freeMem(s->coff);
+  freeMem(s->roff);
+}
+
+void huff_stream_decode(FILE *in, FILE *out)
+{
+  decompressStream(in, out, 1);
+}
+
+void streamBlock(huffStream *s, const unsigned char *p, size_t n)
+{
+  if (s->buf == NULL) {
+    s->buf = (unsigned char *)allocMem(maxBlockBytes(s->blocksize));
+  }
+  writeStreamBlock(s, s->buf, encodeBlock(p, n, s->maxcodelen, s->streams,
+    s->pairs, s->context, s->buf), n);
+}
+
+void writeStreamBlock(huffStream *s, const unsigned char *p, size_t len,
+  size_t n)
+{
+  /* writes the len byte block at p, of n raw bytes, and indexes it */
+  if (fwrite(p, 1, len, s->out) != len) {
+    huffError("failed to write output");
+    fail();
+  }
+  if (s->nblocks + 1 == MAXBLOCKS) {
+    huffError("too many blocks - use a larger block size");
+    fail();
+  }
+  if (s->nblocks + 1 == s->cap) {
+    s->cap *= 2;
+    s->coff = (uint64_t *)reallocMem(s->coff, s->cap * sizeof(uint64_t));
+    s->roff = (uint64_t *)reallocMem(s->roff, s->cap * sizeof(uint64_t));
+  }
+  s->coff[s->nblocks + 1] = s->coff[s->nblocks] + len;
+  s->roff[s->nblocks + 1] = s->roff[s->nblocks] + n;
+  s->nblocks++;
+}
+
+void readBytes(FILE *in, unsigned char *p, size_t n)
+{
+  if (fread(p, 1, n, in) != n) {
+    huffError("compressed data is truncated");
+    fail();
+  }
+}
+
+void skipBytes(FILE *in, size_t n)
+{
+  unsigned char buf[BUFSIZ];
+  size_t len;
+
+  for (; n > 0; n -= len) {
+    len = n < BUFSIZ ? n : BUFSIZ;
+    readBytes(in, buf, len);
+  }
+}
+
+FILE *openFile(char *name, char *mode)
+{
+  /* "-" is stdin for reading, and stdout for writing */
+  FILE *file = strcmp(name, "-") != 0 ? fopen(name, mode)
+    : mode[0] == 'r' ? stdin : stdout;
+  huffCatch *c = getCatch();
+  int i;
+
+  if (file == NULL) {
+    huffError("can't open %s - check name and directory",
+      name);
+    fail();
+  }
+  for (i = 0; c != NULL && file != stdin && file != stdout && i < CATCHFILES;
+    i++) {
+    if (c->files[i] == NULL) {
+      c->files[i] = file;
+      break;
+    }
+  }
+  return file;
+}
+
+void closeFile(FILE *file, char *name)
+{
+  /* stdin is left open, but stdout is closed to catch write errors */
+  huffCatch *c = getCatch();
+  int i;
+
+  for (i = 0; c != NULL && i < CATCHFILES; i++) {
+    if (c->files[i] == file) {
+      c->files[i] = NULL;
+    }
+  }
+  if (file != stdin && fclose(file) != 0) {
+    huffError("failed to write %s", name);
+    fail();
+  }
+}
+
+void openInput(char *filename, inputFile *f)
+{
+  /* Maps the whole file into memory, so every pass over it reads
+   * straight from the page cache with no copying.  Anything that can't
+   * be mapped, such as an empty file or a pipe, is read in instead.
+   * "-" is stdin. */
+  struct stat st;
+  int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO 
+    : open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    huffError("can't open %s - check name and directory",
+      filename);
+    fail();
+  }
+
+  f->data = NULL;
+  f->len = 0;
+  f->mapped = 0;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    f->data = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, 
+      MAP_PRIVATE, fd, 0);
+    if ((void *)f->data != MAP_FAILED) {
+      f->len = st.st_size;
+      f->mapped = 1;
+      posix_madvise(f->data, f->len, POSIX_MADV_SEQUENTIAL);
+      close(fd);
+      trackInput(f);
+      return;
+    }
+  }
+  /* read in, it is allocMem() memory, which a huffCatch tracks anyway */
+  readInput(fd, f);
+  close(fd);
+}
+
+void readInput(int fd, inputFile *f)
+{
+  size_t size = IOBUFSIZE;
+  ssize_t n;
+
+  f->data = (unsigned char *)allocMem(size);
+  while ((n = read(fd, f->data + f->len, size - f->len)) > 0) {
+    f->len += n;
+    if (f->len == size) {
+      size *= 2;
+      f->data = (unsigned char *)reallocMem(f->data, size);
+    }
+  }
+}
+
+void closeInput(inputFile *f)
+{
+  untrackInput(f);
+  if (f->mapped) {
+    munmap(f->data, f->len);
+  }
+  else {
+    freeMem(f->data);
+  }
+}
+
+void trackInput(inputFile *f)
+{
+  huffCatch *c = getCatch();
+
+  if (c != NULL) {
+    c->in = *f;
+    c->hasin = 1;
+  }
+}
+
+void untrackInput(inputFile *f)
+{
+  huffCatch *c = getCatch();
+
+  if (c != NULL && c->hasin && c->in.data == f->data) {
+    c->hasin = 0;
+  }
+}
+
+void *allocMem(size_t size)
+{
+  huffCatch *c = getCatch();
+  void *p = malloc(size);
+
+  if (p == NULL && size != 0) {
+    huffError("malloc of %lu bytes failed", 
+      (unsigned long)size);
+    fail();
+  }
+  if (c != NULL && p != NULL) {
+    trackMem(c, p);
+  }
+  return p;
+}
+
+void *reallocMem(void *p, size_t size)
+{
+  huffCatch *c = getCatch();
+  void *q = realloc(p, size);
+  int i;
+
+  if (q == NULL && size != 0) {
+    huffError("realloc of %lu bytes failed", 
+      (unsigned long)size);
+    fail();
+  }
+  for (i = c != NULL ? c->nmem - 1 : -1; i >= 0; i--) {
+    if (c->mem[i] == p) {
+      c->mem[i] = q;
+      break;
+    }
+  }
+  return q;
+}
+
+void freeMem(void *p)
+{
+  /* frees memory from allocMem(), searching from the latest, which is
+   * usually the one freed */
+  huffCatch *c = getCatch();
+  int i;
+
+  for (i = c != NULL ? c->nmem - 1 : -1; i >= 0; i--) {
+    if (c->mem[i] == p) {
+      c->mem[i] = c->mem[--c->nmem];
+      break;
+    }
+  }
+  free(p);
+}
+
+void trackMem(huffCatch *c, void *p)
+{
+  void **mem;
+
+  if (c->nmem == c->capmem) {
+    mem = (void **)realloc(c->mem, 2 * (c->capmem + 1) * sizeof(void *));
+    if (mem == NULL) {
+      free(p);
+      huffError("malloc tracking failed");
+      fail();
+    }
+    c->mem = mem;
+    c->capmem = 2 * (c->capmem + 1);
+  }
+  c->mem[c->nmem++] = p;
+}
+
+/* Error functions */
+
+pthread_key_t catchKey;
+pthread_once_t catchOnce = PTHREAD_ONCE_INIT;
+
+void huff_catch_begin(huffCatch *c)
+{
+  /* Until huff_catch_end(), an error in this thread jumps back to c->env
+   * instead of exiting, and what the failed call had open is tracked so
+   * that huff_catch_end() can release it.  The caller does the setjmp():
+   *
+   *   if (setjmp(c.env) == 0) {
+   *     huff_catch_begin(&c);
+   *     compressFile(...);
+   *   }
+   *   else ... report c.msg, which says what went wrong ...
+   *   huff_catch_end(&c);
+   *
+   * Only the calling thread is covered, so calls with more than one
+   * thread in huffParams still exit on an error in one of the others. */
+  c->mem = NULL;
+  c->nmem = c->capmem = 0;
+  memset(c->files, 0, sizeof(c->files));
+  c->hasin = 0;
+  c->msg[0] = '\0';
+  getCatch();
+  pthread_setspecific(catchKey, c);
+}
+
+void huff_catch_end(huffCatch *c)
+{
+  /* Releases anything a call that failed left open, and stops catching
+   * errors in this thread */
+  int i;
+
+  pthread_setspecific(catchKey, NULL);
+  for (i = 0; i < c->nmem; i++) {
+    free(c->mem[i]);
+  }
+  free(c->mem);
+  for (i = 0; i < CATCHFILES; i++) {
+    if (c->files[i] != NULL) {
+      fclose(c->files[i]);
+    }
+  }
+  if (c->hasin) {
+    closeInput(&c->in);
+  }
+}
+
+void makeCatchKey(void)
+{
+  pthread_key_create(&catchKey, NULL);
+}
+
+huffCatch *getCatch(void)
+{
+  /* the calling thread's huffCatch, or NULL */
+  pthread_once(&catchOnce, makeCatchKey);
+  return (huffCatch *)pthread_getspecific(catchKey);
+}
+
+void huffError(const char *fmt, ...)
+{
+  /* Reports an error, from a printf() format, as one "ERROR: " line on
+   * stderr, or with a huffCatch set up keeps it in its msg instead, so
+   * the caller can say which of its inputs it was about in the same
+   * line. */
+  huffCatch *c = getCatch();
+  char msg[CATCHMSGLEN];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, CATCHMSGLEN, fmt, ap);
+  va_end(ap);
+  if (c != NULL) {
+    strcpy(c->msg, msg);
+  }
+  else {
+    fprintf(stderr, "ERROR: %s\n", msg);
+  }
+}
+
+void fail(void)
+{
+  /* every error ends here, once it has been reported */
+  huffCatch *c = getCatch();
+
+  if (c != NULL) {
+    longjmp(c->env, 1);
+  }
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,128 @@
+/* huffgrid.c
+ *
+ * Part of libhuff (see huff.h): what huffvis.c and huffsdl.c share, the
+ * counting of the letters they show and the layout of the tree on a
+ * grid of character cells, which one prints and the other draws.
+ *
+ * The layout takes two passes.  One post-order pass finds the height of
+ * every subtree and the distance from its root to its right child, which
+ * is the sum of the distances in its left and right subtrees.  Then one
+ * pass down the tree gives each node its cell.  To keep the tree
+ * compact, each right child is shifted right by the distance of its
+ * sibling, the left child.  Since that is often too far, the shift is
+ * 1) only made if the right child has children of its own, and 2) no
+ * more than the furthest right any node has been put so far, plus the
+ * xoffset every right child moves by anyway.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+char *parseTreeArgs(int argc, char **argv, int *all)
+{
+  /* Returns the file name of "[-a] file", with *all set if -a came
+   * before it */
+  *all = argc == 3 && strcmp(argv[1], "-a") == 0;
+  if (argc != 2 + *all) {
+    fprintf(stderr, "Invalid number of arguments supplied.\n");
+    exit(1);
+  }
+  return argv[1 + *all];
+}
+
+uint64_t *countLetters(char *name, int all, uint64_t *a)
+{
+  /* Counts every byte of the file, then, unless all is set, keeps only
+   * the letters, with lower case added to upper case */
+  int c;
+
+  getFreqsFromFile(name, a, 1);
+  for (c = 0; c < ASIZE && !all; c++) {
+    if (!isalpha(c)) {
+      a[c] = 0;
+    }
+    else if (toupper(c) != c) {
+      a[toupper(c)] += a[c];
+      a[c] = 0;
+    }
+  }
+  return a;
+}
+
+void layoutTree(tree *tr, int xoffset, int yoffset, treeLayout *l)
+{
+  /* Gives every node of tr its cell, with each right child at least
+   * xoffset cells right of its parent, and each left child yoffset
+   * cells below */
+  int n = 2 * tr->len - 1, xmax = 0;
+
+  l->x = (int *)allocMem(n * sizeof(int));
+  l->y = (int *)allocMem(n * sizeof(int));
+  l->height = (int *)allocMem(n * sizeof(int));
+  l->offset = (int *)allocMem(n * sizeof(int));
+  l->xoffset = xoffset;
+  l->yoffset = yoffset;
+  measureTree(tr, tr->root, l);
+  l->ylen = 0;
+  placeTree(tr, tr->root, l, 0, 0, &xmax);
+  l->xlen = l->offset[tr->root] + xoffset;
+}
+
+void measureTree(tree *tr, int n, treeLayout *l)
+{
+  /* fills in the height of n and the distance between it and its right
+   * child, from those of its children */
+  int left = tr->a[n].left, right = tr->a[n].right;
+
+  l->height[n] = 0;
+  l->offset[n] = 0;
+  if (left != NOCHILD) {
+    measureTree(tr, left, l);
+    l->height[n] = l->height[left] + 1;
+  }
+  if (right != NOCHILD) {
+    measureTree(tr, right, l);
+    if (l->height[right] + 1 > l->height[n]) {
+      l->height[n] = l->height[right] + 1;
+    }
+    l->offset[n] = (left != NOCHILD ? l->offset[left] : 0)
+      + l->offset[right] + l->xoffset;
+  }
+}
+
+void placeTree(tree *tr, int n, treeLayout *l, int y, int x, int *xmax)
+{
+  /* gives n and its subtrees their cells, n's at x and y */
+  int dx = 0, left = tr->a[n].left, right = tr->a[n].right;
+
+  if (x > *xmax) {
+    *xmax = x;
+  }
+  if (right != NOCHILD && l->height[right] > 0 && left != NOCHILD) {
+    dx = l->offset[left];
+  }
+  l->x[n] = x;
+  l->y[n] = y;
+  if (y + l->yoffset > l->ylen) {
+    l->ylen = y + l->yoffset;
+  }
+  if (left != NOCHILD) {
+    placeTree(tr, left, l, y + l->yoffset, x, xmax);
+  }
+  if (right != NOCHILD) {
+    placeTree(tr, right, l, y, (x + dx < *xmax ? x + dx : *xmax)
+      + l->xoffset, xmax);
+  }
+}
+
+void freeLayout(treeLayout *l)
+{
+  freeMem(l->x);
+  freeMem(l->y);
+  freeMem(l->height);
+  freeMem(l->offset);
+}
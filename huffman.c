@@ -1,345 +1,941 @@
-/* huffman.c
- * 
- * Function: builds a binary huffman tree from the ASCII-encoded text file
- * given in argv[1], and displays the bit encoding of each character and
- * total number of bytes required to encode. 
- * Usage: filename path/to/textfile
- * 
- * Uses a runtime-sized array of pointers to node structures, where each
- * node tracks the frequency of a particular char in argv[1].  This array
- * is qsorted once, and then to keep it sorted, the insertion point for a
- * parent is found with a binary search and the memmove function is used
- * to move elements within the array and make space for the parent (the 
- * pointers to the 2 child nodes having been set to NULL, there is 
- * spare room).  This avoids normal slow insertion times for arrays,
- * making a linked-list implementation unnecessary.
- * Once the tree is complete, the huffman encodings are found recursively.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <string.h>
-
-#define ASIZE 128 /* size of int array indexed by ASCII chars */
-#define FORMATSTRLEN 128 /* length of format string for printing 
- * huffman encodings */
-#define PNODE -250 /* arbitrary non-ascii char field for the 
- * parent nodes */
-#define BITSPERBYTE 8
-
-typedef struct node {
-  int freq;
-  int c;
-  struct node *left;
-  struct node *right;
-} node;
-
-typedef struct nodeIndex {
-  node **a;
-  int len;
-} nodeIndex;
-
-typedef struct buffer {
-  char *str;
-  short size;
-} buffer;
-
-/* Encoding calculation and printing functions */
-void printHuffman(int *a, node *root);
-int  treeHeight(node *n);
-buffer createBuffer(int size);
-void setFormatString(node *n, buffer *b, char *formatstr);
-void reverseString(char *s);
-node *findEncoding(node *root, int target, buffer *b);
-
-/* Tree-building functions */
-int  *getFreqsFromFile(int argc, char **argv, int *arr);
-int  calcNodeCnt(int *a);
-node *createNode(int c, int freq, node *left, node *right);
-node **createNodeIndex(int *a, int len);
-int  nodeComp(const void * a, const void * b);
-node *populateTree(nodeIndex *index);
-int  getInsertionPoint(int key, nodeIndex *index, int start);
-
-void freeNodes(node *n);
-
-int main(int argc, char **argv)
-{
-  int ascii[ASIZE] = {0};
-  nodeIndex index = {NULL, 0};
-  node *root;
-
-  getFreqsFromFile(argc, argv, ascii);
-  index.len = calcNodeCnt(ascii);
-  index.a = createNodeIndex(ascii, index.len);
-  qsort(index.a, index.len, sizeof(node *), nodeComp);
-  root = populateTree(&index);
-  printHuffman(ascii, root);
-
-  free(index.a);
-  freeNodes(root);
-  return 0;
-}
-
-void printHuffman(int *a, node *root)
-{
-  int i;
-  long unsigned int bits = 0;
-  node *n;
-  buffer b = createBuffer(treeHeight(root));
-  char formatstr[FORMATSTRLEN] = "";
-
-  for (i = 0; i < ASIZE; i++) {
-    if (a[i] != 0) {
-      n = findEncoding(root, i, &b);
-      reverseString(b.str);
-      setFormatString(n, &b, formatstr);
-      fprintf(stdout, formatstr, n->c, b.str, strlen(b.str), n->freq);
-      bits += (strlen(b.str) * n->freq);
-      memset(formatstr,'\0',strlen(formatstr));
-      memset(b.str,'\0',strlen(b.str));
-    }
-  }
-  fprintf(stdout, "%lu Bytes\n\n", 
-    bits / BITSPERBYTE + (bits % BITSPERBYTE != 0)); /* rounds up */
-  free(b.str);
-}
-
-int treeHeight(node *n)
-{
-  int lh, rh;
-  if (n == NULL) {
-    return -1;
-  }
-
-  lh = treeHeight(n->left);
-  rh = treeHeight(n->right);
-
-  if (lh > rh) {
-    return lh + 1;
-  }
-  else {
-    return rh + 1;
-  }
-}
-
-buffer createBuffer(int size)
-{
-  buffer b;
-
-  b.str = (char *)calloc(size + 1,sizeof(char));
-  if (b.str == NULL) {
-    fprintf(stderr,"ERROR: buffer calloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-
-  b.size = size + 1;
-
-  return b;
-}
-
-void setFormatString(node *n, buffer *b, char *formatstr)
-{
-  if (!isprint(n->c)) {
-    sprintf(formatstr, "%%03d :%%%ds", b->size);
-  }
-  else {
-    sprintf(formatstr,  "'%%c' :%%%ds", b->size);
-  }
-  /* Unfortunately snprintf is c99 only, but a buffer overflow
-   * could only happen if b.size is longer than (FORMATSTRLEN - 8)
-   * = 120 digits. */
-  strcat(formatstr," (%3lu * %4d)\n\0");
-}
-
-void reverseString(char *s)
-{
-  /* the recursive method of finding the huffman encoding by traversing
-   * the binary tree results in a backwards string.  */
-  int i, mid = strlen(s) / 2;
-  char *a = s, *b = s + (strlen(s) - 1), temp;
-
-  for(i = 0 ; i < mid; i++, a++, b--) {
-    temp = *a;
-    *a = *b;
-    *b = temp;
-  }
-}
-
-node *findEncoding(node *root, int target, buffer *b)
-{
-  node *ln, *rn, *n = root;
-  static int cnt = 0;
-
-  if (n == root) {
-    cnt = 0; /* reinitialise count for different nodes */
-  }
-  if (n == NULL) {
-    return NULL;
-  }
-  if (n->c == target) {
-    return n;
-  }
-  if ((ln = findEncoding(n->left, target, b)) != NULL) {
-    b->str[cnt++] = '0';
-    return ln;
-  }
-  if ((rn = findEncoding(n->right, target, b)) != NULL) {
-    b->str[cnt++] = '1';
-    return rn;
-  }
-  return NULL;
-}
-
-int *getFreqsFromFile(int argc, char **argv, int *a)
-{
-  FILE *file = fopen(argv[1], "r");
-  int c;
-
-  if (file == NULL) {
-    fprintf(stderr, "Error opening file - check name and directory.\n");
-    exit(1);
-  }
-  if (argc != 2) {
-    fprintf(stderr, "Invalid number of arguments supplied.\n");
-    fprintf(stderr, "This program only requires an ASCII textfile.\n");
-    fclose(file);
-    exit(1);
-  }
-
-  while((c = fgetc(file)) != EOF) {
-    a[c]++;
-  }
-
-  fclose(file);
-  return a;
-}
-
-int calcNodeCnt(int *a)
-{
-  int i, cnt = 0;
-
-  for (i = 0; i < ASIZE; i++) {
-    if (a[i] != 0) {
-      cnt++;
-    }
-  }
-  
-  if (cnt < 2) {
-    fprintf(stderr,"ERROR: too few nodes to build tree\n");
-    exit(EXIT_FAILURE); 
-  }
-  
-  return cnt;
-}
-
-node *createNode(int c, int freq, node *left, node *right)
-{
-  node *p;
-
-  p = (node *)malloc(sizeof(node));
-  if (p == NULL) {
-    fprintf(stderr,"ERROR: node malloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-  p->freq = freq;
-  p->c = c;
-  p->left = left;
-  p->right = right;
-
-  return p;
-}
-
-node **createNodeIndex(int *a, int len)
-{
-  int i, j;
-  node **na = (node **)calloc(len,sizeof(node *));
-
-  if (na == NULL) {
-    fprintf(stderr,"ERROR: index alloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-
-  for (i = 0, j = 0; i < ASIZE; i++) {
-    if (a[i]!= 0) {
-      na[j] = createNode(i, a[i], NULL, NULL);
-      j++;
-    }
-  }
-
-  return na;
-}
-
-int nodeComp(const void * a, const void * b)
-{
-  const node **n1 = (const node **)a;
-  const node **n2 = (const node **)b;
-
-  return (int)((*n1)->freq - (*n2)->freq);
-}
-
-node *populateTree(nodeIndex *index)
-{
-  /* Sorts the array each time using a binary search to find the
-  * insertion point, then memmove to create a space in the array
-  * for the insertion.
-  *
-  * See hufftest.c for testing.  For different tree-building methods, 
-  * (with a test case of 5000 nodes, starting from a sorted 
-  * initial state, no optimisation flags)
-  * representative results are:
-  * time spent to execute qsort: 0.810000s
-  * time spent to execute binary search + memmove: 0.010000s
-  * time spent to execute insertion sort: 0.170000s
-  */
-  int insertpoint, newfreq, lchild, rchild, start = 0;
-  node *parent;
-
-  for (start = 0; start < index->len - 1; start++) {
-    lchild = start; /* lchild and rchild are purely for readability */
-    rchild = start + 1;
-    newfreq = index->a[lchild]->freq + index->a[rchild]->freq;
-    parent = createNode(PNODE, newfreq, index->a[lchild], index->a[rchild]);
-
-    insertpoint = getInsertionPoint(parent->freq, index, start);
-    index->a[lchild] = index->a[rchild] = NULL;
-
-    if (insertpoint > start + 1) {
-      /* if insertpoint is not at beginnning, create room for new node */
-      memmove(index->a, index->a + 1, insertpoint * sizeof(node *));
-    }
-    index->a[insertpoint] = parent;
-  }
-  return index->a[index->len - 1]; /* return pointer to root node */
-}
-
-int getInsertionPoint(int key, nodeIndex *index, int start)
-{
-  int end = index->len - 1, mid;
-
-  while (start <= end) {
-    mid = (start + end) / 2;
-    if (key > index->a[mid]->freq) {
-      start = mid + 1;
-    }
-    else if (key < index->a[mid]->freq){
-      end = mid - 1;
-    }
-    else {
-      return mid;
-    }
-  }
-  return start - 1; /* still need an insertion point,
-  even if no match was found. */
-}
-
-void freeNodes(node *n)
-{
-  if (n == NULL) {
-    return;
-  }
-  freeNodes(n->left);
-  freeNodes(n->right);
-  free(n);
-}
\ No newline at end of file
+/* huffman.c
+ * 
+ * Function: builds a binary huffman tree from the bytes of the file
+ * given in argv[1], and displays the bit encoding of each character and
+ * total number of bytes required to encode.  Can also compress a file to
+ * a packed bitstream, and decompress it again.
+ * Usage: filename [options] path/to/file
+ *        filename [options] -c path/to/infile path/to/outfile (compress)
+ *        filename [options] -d path/to/infile path/to/outfile (decompress)
+ *        filename [options] --train path/to/table samples... (train table)
+ *        filename [options] -c|-d --batch list|dir (many files at once)
+ *        Either file may be "-" for stdin or stdout when compressing or
+ *        decompressing.
+ * Options: --max-code-len N  build codes of at most N bits (N <= 15) with
+ *                            package-merge instead of populateTree()
+ *          -b SIZE           compress in blocks of SIZE bytes (default 1M)
+ *          -j N              count, compress or decompress with N threads
+ *          --streams N       compress each block as N = 4 interleaved
+ *                            bitstreams, which decompress faster
+ *          --pairs           code blocks by byte pair instead of by byte
+ *                            wherever that is smaller, as for text
+ *          --context         code blocks with up to 8 tables, picked by
+ *                            the byte before, wherever that is smaller
+ *          --seek SIZE       add a seek table with an entry every SIZE
+ *                            bytes (even) of each block, for --range
+ *          --range S:N       decompress only the N bytes from offset S,
+ *                            decoding just the blocks, or with a seek
+ *                            table the parts of them, that hold them
+ *          -a                compress in one pass with adaptive codes,
+ *                            for small inputs or ones that can't wait
+ *          --table FILE      compress or decompress with the codes of a
+ *                            table made by --train, with no blocks or
+ *                            code lengths, for many small similar files
+ *          --estimate N      count only every Nth 64K of the file, and
+ *                            print the estimated size's standard error
+ *          --batch           compress or decompress every file named in
+ *                            the list, one per line, or in the directory,
+ *                            on -j threads, to NAME.huf, or back to NAME
+ *          --stats           print timings and tree statistics as JSON
+ *          --perf            as --stats, with hardware counters as well
+ * 
+ * --estimate maps the file but only reads the chunks it counts, so huge
+ * files can be sized in a fraction of the time.  The counts printed are
+ * scaled up to the whole file, and the error is that of a ratio
+ * estimate: the bits per byte of the chunks counted, times the length.
+ *
+ * The counting, tree-building, encoding and decoding are all done by
+ * libhuff, described in huff.h, so this file only parses the options and
+ * prints the codes.  Build with 'make huffman'.
+ *
+ * --batch does every file in one process, for many small files where
+ * starting a process for each would take longer than the compression.
+ * Each thread takes the next file and works on it alone, and a file that
+ * fails is reported and its output removed, without stopping the rest.
+ * The exit status is 1 if any failed.  In a directory, only the .huf
+ * files are decompressed, and the others compressed.  A --table is
+ * loaded once and shared by every thread.
+ *
+ * --stats writes one line of JSON to stderr at the end: the wall time
+ * and throughput of each stage, the peak memory, and, when printing the
+ * codes, the node count, tree height, and average code length against
+ * the entropy.  The height is that of the codes printed, so with
+ * --max-code-len it is within the limit, unlike the unlimited tree.
+ * Compression and decompression are timed as one stage, since their
+ * stages run a block at a time inside libhuff.  With --perf, cycles,
+ * instructions, cache misses and branch misses are counted with
+ * perf_event_open() where the kernel allows it (Linux only), including
+ * any threads, and are null otherwise.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime() and getrusage() */
+#define _DEFAULT_SOURCE /* for syscall(), to open hardware counters */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "huff.h"
+
+#define PRINTMODE 0
+#define COMPRESSMODE 1
+#define DECOMPRESSMODE 2
+#define TRAINMODE 3
+#define NSTAGES 7
+#define HUFSUFFIX ".huf" /* added to the names of --batch outputs */
+#define OUTSUFFIX ".out" /* or when decompressing, if there's no .huf */
+#define LISTBUFSIZE 4096 /* longest line of a --batch list */
+#define NCOUNTERS 4
+
+enum stage {HISTSTAGE, QSORTSTAGE, TREESTAGE, CODESTAGE, OUTSTAGE,
+  COMPRESSSTAGE, DECOMPRESSSTAGE};
+
+typedef struct options {
+  int mode;
+  int stats; /* 1 for --stats, 2 to read hardware counters too */
+  huffParams hp;
+  char *inname, *outname;
+  char *tablename; /* --table, or NULL */
+  char **samples; /* the files to train a table on */
+  int nsamples;
+  int every; /* --estimate: count every Nth SAMPLECHUNK, or 0 for all */
+  int batch; /* 1 if inname is a --batch list or directory */
+  int range; /* 1 to decompress only --range start:len */
+  uint64_t start, len;
+} options;
+
+typedef struct batchJob {
+  options *opt;
+  char **names;
+  int n;
+  pthread_mutex_t lock; /* guards the rest */
+  int next, failed;
+} batchJob;
+
+typedef struct stats {
+  double start, last;
+  double stage[NSTAGES]; /* seconds, or -1 if the stage didn't run */
+  int fd[NCOUNTERS];     /* hardware counters, or -1 */
+  uint64_t count[NCOUNTERS];
+} stats;
+
+/* Encoding calculation and printing functions */
+void printHuffman(uint64_t *a, codeTable *t);
+void printEstimate(const unsigned char *p, size_t n, int every,
+  codeTable *t);
+void codeToString(uint64_t code, int len, char *str);
+
+/* Argument functions */
+void parseArgs(int argc, char **argv, options *opt);
+void printUsage(char *prog);
+size_t parseSize(char *s);
+int  parseRange(char *s, uint64_t *start, uint64_t *len);
+
+/* Batch functions */
+int  runBatch(options *opt);
+char **readBatchList(char *name, int mode, int *n);
+char **readBatchDir(char *name, int mode, int *n);
+void addBatchName(char ***names, int *n, int *cap, char *dir, char *name);
+int  nameComp(const void *a, const void *b);
+void *batchWorker(void *arg);
+int  batchFile(options *opt, char *name, huffCatch *c);
+char *batchOutName(char *name, int mode);
+int  hasSuffix(char *name, char *suffix);
+
+/* Statistics functions */
+void startStats(stats *st, int counters);
+void endStage(stats *st, int s);
+void printStats(stats *st, options *opt, uint64_t *a, tree *tr, 
+  codeTable *t);
+void printFileBytes(char *key, char *name);
+void printJsonString(char *str);
+double rate(double bytes, double secs);
+double getSeconds(void);
+int  openCounter(uint32_t type, uint64_t config);
+void readCounters(stats *st);
+
+int main(int argc, char **argv)
+{
+  uint64_t freqs[ASIZE] = {0}, padded[ASIZE];
+  tree tr = {NULL, 0, 0};
+  codeTable t;
+  options opt;
+  stats st;
+  inputFile f;
+
+  parseArgs(argc, argv, &opt);
+  if (opt.tablename != NULL) {
+    opt.hp.table = (huffTable *)allocMem(sizeof(huffTable));
+    loadTable(opt.tablename, opt.hp.table);
+  }
+  if (opt.batch) {
+    return runBatch(&opt) == 0 ? 0 : EXIT_FAILURE;
+  }
+  startStats(&st, opt.stats == 2);
+  if (opt.mode == TRAINMODE) {
+    trainTable(opt.samples, opt.nsamples, opt.hp.maxcodelen, 
+      opt.hp.threads, &t);
+    writeTable(opt.outname, &t);
+    return 0;
+  }
+  else if (opt.mode == COMPRESSMODE) {
+    compressFile(opt.inname, opt.outname, &opt.hp);
+    endStage(&st, COMPRESSSTAGE);
+  }
+  else if (opt.mode == DECOMPRESSMODE && opt.range) {
+    decompressRange(opt.inname, opt.outname, opt.start, opt.len);
+    endStage(&st, DECOMPRESSSTAGE);
+  }
+  else if (opt.mode == DECOMPRESSMODE) {
+    decompressFile(opt.inname, opt.outname, &opt.hp);
+    endStage(&st, DECOMPRESSSTAGE);
+  }
+  else {
+    if (opt.every > 0) {
+      openInput(opt.inname, &f);
+      sampleFreqs(f.data, f.len, opt.every, freqs);
+    }
+    else {
+      getFreqsFromFile(opt.inname, freqs, opt.hp.threads);
+    }
+    endStage(&st, HISTSTAGE);
+    tr.len = calcNodeCnt(freqs);
+    tr.a = createNodeArray(freqs, tr.len);
+    qsort(tr.a, tr.len, sizeof(node), nodeComp);
+    endStage(&st, QSORTSTAGE);
+    tr.root = populateTree(&tr);
+    endStage(&st, TREESTAGE);
+    if (opt.hp.maxcodelen != 0) {
+      /* the codes -c would use, from counts padded as it pads them */
+      memcpy(padded, freqs, sizeof(padded));
+      padFreqs(padded);
+      buildCodes(padded, opt.hp.maxcodelen, &t);
+    }
+    else {
+      buildCodeTable(&tr, &t);
+    }
+    endStage(&st, CODESTAGE);
+    printHuffman(freqs, &t);
+    if (opt.every > 0) {
+      printEstimate(f.data, f.len, opt.every, &t);
+      closeInput(&f);
+    }
+    fflush(stdout);
+    endStage(&st, OUTSTAGE);
+  }
+
+  if (opt.stats) {
+    printStats(&st, &opt, freqs, &tr, &t);
+  }
+  freeMem(tr.a);
+  freeMem(opt.hp.table);
+  return 0;
+}
+
+void parseArgs(int argc, char **argv, options *opt)
+{
+  int i;
+
+  opt->mode = PRINTMODE;
+  opt->stats = 0;
+  opt->hp.maxcodelen = 0;
+  opt->hp.threads = 1;
+  opt->hp.blocksize = BLOCKSIZE;
+  opt->hp.streams = 1;
+  opt->hp.adaptive = 0;
+  opt->hp.pairs = 0;
+  opt->hp.context = 0;
+  opt->hp.seek = 0;
+  opt->hp.table = NULL;
+  opt->tablename = NULL;
+  opt->every = 0;
+  opt->batch = 0;
+  opt->range = 0;
+  opt->inname = opt->outname = NULL;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+    if (strcmp(argv[i], "--max-code-len") == 0 && i + 1 < argc) {
+      opt->hp.maxcodelen = atoi(argv[++i]);
+      if (opt->hp.maxcodelen < 1 || opt->hp.maxcodelen > MAXCODELEN) {
+        fprintf(stderr, "ERROR: max code length must be 1 - %d\n",
+          MAXCODELEN);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      opt->hp.threads = atoi(argv[++i]);
+      if (opt->hp.threads < 1 || opt->hp.threads > MAXTHREADS) {
+        fprintf(stderr, "ERROR: thread count must be 1 - %d\n", MAXTHREADS);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      opt->hp.blocksize = parseSize(argv[++i]);
+      if (opt->hp.blocksize < MINBLOCKSIZE
+        || opt->hp.blocksize > MAXBLOCKSIZE) {
+        fprintf(stderr, "ERROR: block size must be %d - %d bytes\n",
+          MINBLOCKSIZE, MAXBLOCKSIZE);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+      opt->hp.streams = atoi(argv[++i]);
+      if (opt->hp.streams != 1 && opt->hp.streams != NSTREAMS) {
+        fprintf(stderr, "ERROR: stream count must be 1 or %d\n", NSTREAMS);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--pairs") == 0) {
+      opt->hp.pairs = 1;
+    }
+    else if (strcmp(argv[i], "--context") == 0) {
+      opt->hp.context = 1;
+    }
+    else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+      opt->hp.seek = parseSize(argv[++i]);
+      if (opt->hp.seek == 0 || opt->hp.seek % 2 != 0) {
+        fprintf(stderr, "ERROR: seek interval must be an even number of"
+          " bytes\n");
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc) {
+      opt->range = 1;
+      if (!parseRange(argv[++i], &opt->start, &opt->len)) {
+        fprintf(stderr, "ERROR: range must be start:len, in bytes\n");
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--table") == 0 && i + 1 < argc) {
+      opt->tablename = argv[++i];
+    }
+    else if (strcmp(argv[i], "--train") == 0) {
+      opt->mode = TRAINMODE;
+    }
+    else if (strcmp(argv[i], "-a") == 0) {
+      opt->hp.adaptive = 1;
+    }
+    else if (strcmp(argv[i], "--estimate") == 0 && i + 1 < argc) {
+      opt->every = atoi(argv[++i]);
+      if (opt->every < 1) {
+        fprintf(stderr, "ERROR: --estimate needs a chunk stride of 1 or"
+          " more\n");
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--batch") == 0) {
+      opt->batch = 1;
+    }
+    else if (strcmp(argv[i], "--stats") == 0) {
+      opt->stats = opt->stats > 1 ? opt->stats : 1;
+    }
+    else if (strcmp(argv[i], "--perf") == 0) {
+      opt->stats = 2;
+    }
+    else if (strcmp(argv[i], "-c") == 0) {
+      opt->mode = COMPRESSMODE;
+    }
+    else if (strcmp(argv[i], "-d") == 0) {
+      opt->mode = DECOMPRESSMODE;
+    }
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      printUsage(argv[0]);
+    }
+  }
+
+  if (opt->batch && i == argc - 1
+    && (opt->mode == COMPRESSMODE || opt->mode == DECOMPRESSMODE)) {
+    opt->inname = argv[i];
+  }
+  else if (opt->batch) {
+    fprintf(stderr, "--batch needs -c or -d, and a list or directory.\n");
+    printUsage(argv[0]);
+  }
+  else if (opt->range && opt->mode != DECOMPRESSMODE) {
+    fprintf(stderr, "--range needs -d.\n");
+    printUsage(argv[0]);
+  }
+  else if (opt->mode == PRINTMODE && i == argc - 1) {
+    opt->inname = argv[i];
+  }
+  else if (opt->mode == TRAINMODE && i < argc - 1) {
+    opt->outname = argv[i];
+    opt->samples = argv + i + 1;
+    opt->nsamples = argc - i - 1;
+  }
+  else if (opt->mode != PRINTMODE && i == argc - 2) {
+    opt->inname = argv[i];
+    opt->outname = argv[i + 1];
+  }
+  else {
+    fprintf(stderr, "Invalid number of arguments supplied.\n");
+    printUsage(argv[0]);
+  }
+}
+
+void printUsage(char *prog)
+{
+  fprintf(stderr, "Usage: %s [options] file\n", prog);
+  fprintf(stderr, "       %s [options] -c infile outfile\n", prog);
+  fprintf(stderr, "       %s [options] -d infile outfile\n", prog);
+  fprintf(stderr, "       %s [options] --train table samples...\n", prog);
+  fprintf(stderr, "       %s [options] -c|-d --batch list|dir\n", prog);
+  fprintf(stderr, "Options: --max-code-len N  codes of at most N bits\n");
+  fprintf(stderr, "         -b SIZE           compress in blocks of SIZE"
+    " bytes, or SIZEK or SIZEM\n");
+  fprintf(stderr, "         -j N              use N threads\n");
+  fprintf(stderr, "         --streams N       interleave N = %d bitstreams"
+    " per block\n", NSTREAMS);
+  fprintf(stderr, "         --pairs           code by byte pair where"
+    " smaller\n");
+  fprintf(stderr, "         --context         code by order-1 context"
+    " where smaller\n");
+  fprintf(stderr, "         --seek SIZE       seek table entry every SIZE"
+    " bytes, for --range\n");
+  fprintf(stderr, "         --range S:N       decompress N bytes from"
+    " offset S only\n");
+  fprintf(stderr, "         -a                one-pass adaptive codes\n");
+  fprintf(stderr, "         --table FILE      use the codes of a trained"
+    " table\n");
+  fprintf(stderr, "         --estimate N      count every Nth 64K only,"
+    " and print the error\n");
+  fprintf(stderr, "         --batch           every file in a list or"
+    " directory\n");
+  fprintf(stderr, "         --stats           timings as JSON on stderr\n");
+  fprintf(stderr, "         --perf            --stats and hardware"
+    " counters\n");
+  fprintf(stderr, "Use - for stdin or stdout when compressing or"
+    " decompressing.\n");
+  exit(1);
+}
+
+size_t parseSize(char *s)
+{
+  /* a number of bytes, with an optional K or M suffix, or 0 if s isn't
+   * one */
+  char *end;
+  unsigned long n = strtoul(s, &end, 10);
+  int shift = 0;
+
+  if (*end == 'K' || *end == 'k') {
+    shift = 10;
+    end++;
+  }
+  else if (*end == 'M' || *end == 'm') {
+    shift = 20;
+    end++;
+  }
+  if (*end != '\0' || end == s || n > (unsigned long)MAXBLOCKSIZE >> shift) {
+    return 0;
+  }
+  return n << shift;
+}
+
+int parseRange(char *s, uint64_t *start, uint64_t *len)
+{
+  /* reads "start:len" into start and len, returning 0 if s isn't that */
+  char *end;
+
+  if (!isdigit((unsigned char)s[0])) {
+    return 0;
+  }
+  *start = strtoul(s, &end, 10);
+  if (*end != ':' || !isdigit((unsigned char)end[1])) {
+    return 0;
+  }
+  s = end + 1;
+  *len = strtoul(s, &end, 10);
+  return *end == '\0';
+}
+
+void printHuffman(uint64_t *a, codeTable *t)
+{
+  int i, width = 0;
+  uint64_t bits;
+  char str[ACCBITS + 1];
+
+  for (i = 0; i < ASIZE; i++) {
+    if (t->len[i] > width) {
+      width = t->len[i]; /* the height of the tree */
+    }
+  }
+  width++;
+
+  for (i = 0; i < ASIZE; i++) {
+    if (a[i] != 0) {
+      codeToString(t->code[i], t->len[i], str);
+      if (!isprint(i)) {
+        fprintf(stdout, "%03d :%*s", i, width, str);
+      }
+      else {
+        fprintf(stdout, "'%c' :%*s", i, width, str);
+      }
+      fprintf(stdout, " (%3d * %4lu)\n", t->len[i], (unsigned long)a[i]);
+    }
+  }
+  bits = codedBits(a, t);
+  fprintf(stdout, "%lu Bytes\n\n", (unsigned long)
+    (bits / BITSPERBYTE + (bits % BITSPERBYTE != 0))); /* rounds up */
+}
+
+void printEstimate(const unsigned char *p, size_t n, int every,
+  codeTable *t)
+{
+  /* The chunks sampleFreqs() counted are counted again, one at a time,
+   * for the bits each takes with t.  The estimate is their bits per
+   * byte times n, so its spread is that of each chunk's bits about that
+   * rate, less the share of the file counted. */
+  uint64_t freqs[ASIZE];
+  size_t i, m, total = (n + SAMPLECHUNK - 1) / SAMPLECHUNK;
+  double *bits = (double *)allocMem((total / every + 1) * sizeof(double));
+  double *len = (double *)allocMem((total / every + 1) * sizeof(double));
+  double sum = 0, bytes = 0, rate, var = 0, err;
+
+  for (m = 0, i = 0; i < n; i += (size_t)every * SAMPLECHUNK, m++) {
+    len[m] = n - i < SAMPLECHUNK ? n - i : SAMPLECHUNK;
+    memset(freqs, 0, sizeof(freqs));
+    countBytes(p + i, len[m], freqs);
+    bits[m] = codedBits(freqs, t);
+    sum += bits[m];
+    bytes += len[m];
+  }
+  rate = bytes > 0 ? sum / bytes : 0;
+  for (i = 0; i < m; i++) {
+    var += (bits[i] - rate * len[i]) * (bits[i] - rate * len[i]);
+  }
+
+  fprintf(stdout, "Estimated from %lu of %lu chunks of %d bytes: ",
+    (unsigned long)m, (unsigned long)total, SAMPLECHUNK);
+  if (m == total) {
+    fprintf(stdout, "exact\n\n");
+  }
+  else if (m < 2) {
+    fprintf(stdout, "error unknown, too few chunks\n\n");
+  }
+  else {
+    err = total * sqrt((1 - (double)m / total) * var / (m - 1) / m);
+    fprintf(stdout, "+/- %.0f Bytes (standard error, %.2f%%)\n\n",
+      err / BITSPERBYTE, 100 * err / (rate * n));
+  }
+  freeMem(bits);
+  freeMem(len);
+}
+
+void codeToString(uint64_t code, int len, char *str)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    str[i] = (code >> (len - 1 - i)) & 1 ? '1' : '0';
+  }
+  str[len] = '\0';
+}
+
+int runBatch(options *opt)
+{
+  /* Does every file of the batch on a pool of opt->hp.threads threads,
+   * or here if none can be started, and returns how many failed */
+  pthread_t tid[MAXTHREADS];
+  batchJob job;
+  int i, started = 0;
+
+  job.opt = opt;
+  job.names = readBatchList(opt->inname, opt->mode, &job.n);
+  job.next = job.failed = 0;
+  pthread_mutex_init(&job.lock, NULL);
+  for (i = 0; opt->hp.threads > 1 && i < opt->hp.threads && i < job.n; i++) {
+    if (pthread_create(&tid[started], NULL, batchWorker, &job) == 0) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    batchWorker(&job);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  if (job.failed > 0) {
+    fprintf(stderr, "ERROR: %d of %d files failed\n", job.failed, job.n);
+  }
+  for (i = 0; i < job.n; i++) {
+    freeMem(job.names[i]);
+  }
+  freeMem(job.names);
+  return job.failed;
+}
+
+char **readBatchList(char *name, int mode, int *n)
+{
+  /* the names in the list file, one per line, or "-" for stdin, or the
+   * files in the directory */
+  FILE *list;
+  struct stat sb;
+  char line[LISTBUFSIZE], **names = NULL;
+  size_t len;
+  int cap = 0;
+
+  if (stat(name, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+    return readBatchDir(name, mode, n);
+  }
+  list = openFile(name, "r");
+  *n = 0;
+  while (fgets(line, LISTBUFSIZE, list) != NULL) {
+    len = strlen(line);
+    if (len == LISTBUFSIZE - 1 && line[len - 1] != '\n') {
+      huffError("line %d of %s is too long", *n + 1, name);
+      fail();
+    }
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+    if (len > 0) {
+      addBatchName(&names, n, &cap, NULL, line);
+    }
+  }
+  if (ferror(list)) {
+    huffError("failed to read %s", name);
+    fail();
+  }
+  closeFile(list, name);
+  return names;
+}
+
+char **readBatchDir(char *name, int mode, int *n)
+{
+  /* The regular files in the directory, in order of name, leaving out
+   * those that aren't .huf files when decompressing, or are when
+   * compressing, so a batch can be run again over its own output. */
+  DIR *dir = opendir(name);
+  struct dirent *d;
+  struct stat sb;
+  char **names = NULL;
+  int cap = 0;
+
+  if (dir == NULL) {
+    huffError("can't open directory %s", name);
+    fail();
+  }
+  *n = 0;
+  while ((d = readdir(dir)) != NULL) {
+    if (hasSuffix(d->d_name, HUFSUFFIX) == (mode == DECOMPRESSMODE)) {
+      addBatchName(&names, n, &cap, name, d->d_name);
+      if (stat(names[*n - 1], &sb) != 0 || !S_ISREG(sb.st_mode)) {
+        freeMem(names[--*n]);
+      }
+    }
+  }
+  closedir(dir);
+  qsort(names, *n, sizeof(char *), nameComp);
+  return names;
+}
+
+void addBatchName(char ***names, int *n, int *cap, char *dir, char *name)
+{
+  /* appends dir/name, or just name if dir is NULL */
+  size_t len = (dir != NULL ? strlen(dir) + 1 : 0) + strlen(name) + 1;
+  char *s = (char *)allocMem(len);
+
+  if (*n == *cap) {
+    *cap = 2 * *cap + 1;
+    *names = (char **)reallocMem(*names, *cap * sizeof(char *));
+  }
+  if (dir != NULL) {
+    sprintf(s, "%s/%s", dir, name);
+  }
+  else {
+    strcpy(s, name);
+  }
+  (*names)[(*n)++] = s;
+}
+
+int nameComp(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+void *batchWorker(void *arg)
+{
+  /* takes the next file until there are none left, each on its own */
+  batchJob *job = (batchJob *)arg;
+  huffCatch c;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next < job->n ? job->next++ : -1;
+    pthread_mutex_unlock(&job->lock);
+    if (i < 0) {
+      return NULL;
+    }
+    if (batchFile(job->opt, job->names[i], &c)) {
+      pthread_mutex_lock(&job->lock);
+      job->failed++;
+      pthread_mutex_unlock(&job->lock);
+    }
+  }
+}
+
+int batchFile(options *opt, char *name, huffCatch *c)
+{
+  /* Compresses or decompresses one file of a batch, with one thread, and
+   * returns 1 if it failed, after reporting why in one line with the
+   * file's name.  Everything libhuff had open is released. */
+  char *outname = batchOutName(name, opt->mode);
+  huffParams hp = opt->hp;
+  int failed = 0;
+
+  hp.threads = 1;
+  if (setjmp(c->env) == 0) {
+    huff_catch_begin(c);
+    if (opt->mode == COMPRESSMODE) {
+      compressFile(name, outname, &hp);
+    }
+    else {
+      decompressFile(name, outname, &hp);
+    }
+  }
+  else {
+    failed = 1;
+  }
+  huff_catch_end(c);
+  if (failed) {
+    fprintf(stderr, "ERROR: %s: %s\n", name, c->msg);
+    remove(outname);
+  }
+  freeMem(outname);
+  return failed;
+}
+
+char *batchOutName(char *name, int mode)
+{
+  /* name.huf when compressing, or without the .huf when decompressing,
+   * or with .out if it has none */
+  char *s = (char *)allocMem(strlen(name) + sizeof(HUFSUFFIX) 
+    + sizeof(OUTSUFFIX));
+
+  strcpy(s, name);
+  if (mode == COMPRESSMODE) {
+    strcat(s, HUFSUFFIX);
+  }
+  else if (hasSuffix(s, HUFSUFFIX) && strlen(s) > strlen(HUFSUFFIX)) {
+    s[strlen(s) - strlen(HUFSUFFIX)] = '\0';
+  }
+  else {
+    strcat(s, OUTSUFFIX);
+  }
+  return s;
+}
+
+int hasSuffix(char *name, char *suffix)
+{
+  size_t n = strlen(name), k = strlen(suffix);
+
+  return n >= k && strcmp(name + n - k, suffix) == 0;
+}
+
+void startStats(stats *st, int counters)
+{
+  /* Every stage starts when the one before it ends, so the stages add
+   * up to the wall time. */
+  uint32_t type[NCOUNTERS] = {0};
+  uint64_t config[NCOUNTERS] = {0};
+  int i;
+
+#ifdef __linux__
+  type[0] = type[1] = type[2] = type[3] = PERF_TYPE_HARDWARE;
+  config[0] = PERF_COUNT_HW_CPU_CYCLES;
+  config[1] = PERF_COUNT_HW_INSTRUCTIONS;
+  config[2] = PERF_COUNT_HW_CACHE_MISSES;
+  config[3] = PERF_COUNT_HW_BRANCH_MISSES;
+#endif
+  for (i = 0; i < NSTAGES; i++) {
+    st->stage[i] = -1;
+  }
+  for (i = 0; i < NCOUNTERS; i++) {
+    st->fd[i] = counters ? openCounter(type[i], config[i]) : -1;
+  }
+  st->start = st->last = getSeconds();
+}
+
+void endStage(stats *st, int s)
+{
+  double now = getSeconds();
+
+  st->stage[s] = now - st->last;
+  st->last = now;
+}
+
+void printStats(stats *st, options *opt, uint64_t *a, tree *tr, 
+  codeTable *t)
+{
+  static char *names[NSTAGES] = {"histogram", "qsort", "populate_tree",
+    "code_table", "output", "compress", "decompress"};
+  static char *counters[NCOUNTERS] = {"cycles", "instructions",
+    "cache_misses", "branch_misses"};
+  double n = 0, bits, entropy, wall = st->last - st->start;
+  struct rusage ru;
+  struct stat sb;
+  int i, longest = 0, first = 1;
+
+  readCounters(st);
+  if (opt->mode == PRINTMODE) {
+    for (i = 0; i < ASIZE; i++) {
+      n += a[i];
+    }
+  }
+  else if (stat(opt->inname, &sb) == 0 && S_ISREG(sb.st_mode)) {
+    n = sb.st_size;
+  }
+
+  fprintf(stderr, "{\"mode\": \"%s\", \"input\": ", opt->mode == PRINTMODE
+    ? "print" : opt->mode == COMPRESSMODE ? "compress" : "decompress");
+  printJsonString(opt->inname);
+  if (opt->mode == PRINTMODE) {
+    fprintf(stderr, ", \"input_bytes\": %.0f", n);
+  }
+  else {
+    printFileBytes("input_bytes", opt->inname);
+    printFileBytes("output_bytes", opt->outname);
+  }
+  fprintf(stderr, ", \"threads\": %d, \"wall_s\": %.6f, \"MB_per_s\": %.1f",
+    opt->hp.threads, wall, rate(n, wall));
+
+  fprintf(stderr, ", \"stages\": {");
+  for (i = 0; i < NSTAGES; i++) {
+    if (st->stage[i] >= 0) {
+      fprintf(stderr, "%s\"%s\": {\"s\": %.6f, \"MB_per_s\": %.1f}", 
+        first ? "" : ", ", names[i], st->stage[i], rate(n, st->stage[i]));
+      first = 0;
+    }
+  }
+  fprintf(stderr, "}");
+
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(stderr, ", \"peak_rss_kb\": %ld", (long)ru.ru_maxrss);
+
+  if (opt->mode == PRINTMODE) {
+    /* entropy is the least average code length any code could have, and
+     * the height is the longest code in t, as tr is not length limited */
+    for (i = 0; i < ASIZE; i++) {
+      if (t->len[i] > longest) {
+        longest = t->len[i];
+      }
+    }
+    bits = codedBits(a, t);
+    entropy = entropyBits(a) / n;
+    fprintf(stderr, ", \"leaves\": %d, \"nodes\": %d, \"height\": %d, "
+      "\"avg_code_len\": %.4f, \"entropy\": %.4f", tr->len, 2 * tr->len - 1,
+      longest, bits / n, entropy);
+  }
+
+  fprintf(stderr, ", \"perf\": {");
+  for (i = 0; i < NCOUNTERS; i++) {
+    fprintf(stderr, i == 0 ? "\"%s\": " : ", \"%s\": ", counters[i]);
+    if (st->fd[i] < 0) {
+      fprintf(stderr, "null");
+    }
+    else {
+      fprintf(stderr, "%lu", (unsigned long)st->count[i]);
+    }
+  }
+  fprintf(stderr, "}}\n");
+}
+
+void printFileBytes(char *key, char *name)
+{
+  /* the size of a file, or null for "-" or if it can't be found */
+  struct stat sb;
+
+  fprintf(stderr, ", \"%s\": ", key);
+  if (strcmp(name, "-") != 0 && stat(name, &sb) == 0 
+    && S_ISREG(sb.st_mode)) {
+    fprintf(stderr, "%lu", (unsigned long)sb.st_size);
+  }
+  else {
+    fprintf(stderr, "null");
+  }
+}
+
+void printJsonString(char *str)
+{
+  fputc('"', stderr);
+  for (; *str != '\0'; str++) {
+    if (*str == '"' || *str == '\\') {
+      fprintf(stderr, "\\%c", *str);
+    }
+    else if ((unsigned char)*str < ' ') {
+      fprintf(stderr, "\\u%04x", *str);
+    }
+    else {
+      fputc(*str, stderr);
+    }
+  }
+  fputc('"', stderr);
+}
+
+double rate(double bytes, double secs)
+{
+  /* MB/s, or 0 rather than infinity for a stage too quick to time */
+  return secs > 0 ? bytes / secs / 1e6 : 0;
+}
+
+double getSeconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int openCounter(uint32_t type, uint64_t config)
+{
+  /* Counts this process in user space, and any threads it starts, from
+   * now.  Returns -1 if the counter isn't available. */
+#ifdef __linux__
+  struct perf_event_attr pe;
+  int fd;
+
+  memset(&pe, 0, sizeof(pe));
+  pe.type = type;
+  pe.size = sizeof(pe);
+  pe.config = config;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  pe.inherit = 1;
+  fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+  return fd < 0 ? -1 : fd;
+#else
+  (void)type;
+  (void)config;
+  return -1;
+#endif
+}
+
+void readCounters(stats *st)
+{
+  int i;
+
+  for (i = 0; i < NCOUNTERS; i++) {
+    if (st->fd[i] >= 0 && read(st->fd[i], &st->count[i], 
+      sizeof(uint64_t)) != sizeof(uint64_t)) {
+      close(st->fd[i]);
+      st->fd[i] = -1;
+    }
+  }
+}
@@ -0,0 +1,391 @@
+/* huffpair.c
+ *
+ * Part of libhuff (see huff.h): codes a block two bytes at a time, over
+ * an alphabet of all PAIRSYMS byte pairs, which captures how often each
+ * byte follows another as well as how often it occurs.  On English text
+ * this saves around a sixth over coding single bytes.
+ *
+ * A BLOCKPAIR block has, after the usual block header, the last byte if
+ * the length is odd, the number of pairs used, then each pair used, in
+ * order, as the gap from the last one, in 7-bit groups with the top bit
+ * set on all but the last, and its code length in a byte.  The codes are
+ * canonical, up to PAIRMAXCODELEN bits, so the bitstream follows on with
+ * one code for every two bytes.  The codes come from the same sorted
+ * leaves and populateTree() as the byte codes, with only the leaves in
+ * use, however big the alphabet.
+ *
+ * Most blocks of binary data use so many pairs that the list costs more
+ * than it saves, so the pair block is only written when it comes out
+ * smaller than the byte block would be.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+#define PAIRTABLEBITS 12 /* bits looked up at once by the pair decoder */
+#define NPAIRSHDRLEN 3 /* bytes holding the number of pairs used */
+#define GAPBITS 7 /* bits of a pair gap in each byte of the list */
+#define MAXGAPLEN 3 /* most bytes a gap can take */
+
+size_t encodePairBlock(const unsigned char *p, size_t n, size_t limit,
+  unsigned char *out)
+{
+  /* Writes p as a BLOCKPAIR block and returns its length, or returns 0
+   * without writing if it would come to limit bytes or more. */
+  uint64_t *freqs = (uint64_t *)allocMem(PAIRSYMS * sizeof(uint64_t));
+  uint32_t *code = (uint32_t *)allocMem(PAIRSYMS * sizeof(uint32_t));
+  unsigned char *len = (unsigned char *)allocMem(PAIRSYMS);
+  uint64_t bits = 0;
+  size_t hdr, i, size;
+  bitWriter w;
+  int nsyms, s, last;
+
+  memset(freqs, 0, PAIRSYMS * sizeof(uint64_t));
+  for (i = 0; i + 1 < n; i += 2) {
+    freqs[p[i] << BITSPERBYTE | p[i + 1]]++;
+  }
+  nsyms = pairLengths(freqs, len);
+
+  hdr = BLOCKHDRLEN + n % 2 + NPAIRSHDRLEN;
+  for (s = 0, last = -1; s < PAIRSYMS; s++) {
+    if (len[s] != 0) {
+      hdr += gapBytes(s - last - 1) + 1;
+      bits += freqs[s] * len[s];
+      last = s;
+    }
+  }
+  size = hdr + (bits + BITSPERBYTE - 1) / BITSPERBYTE;
+  if (size < limit) {
+    out[0] = BLOCKPAIR;
+    writeUint(out + 1, n, 4);
+    writeUint(out + 5, size - BLOCKHDRLEN, 4);
+    hdr = BLOCKHDRLEN;
+    if (n % 2 == 1) {
+      out[hdr++] = p[n - 1];
+    }
+    writeUint(out + hdr, nsyms, NPAIRSHDRLEN);
+    hdr += NPAIRSHDRLEN;
+    for (s = 0, last = -1; s < PAIRSYMS; s++) {
+      if (len[s] != 0) {
+        hdr += writeGap(out + hdr, s - last - 1);
+        out[hdr++] = len[s];
+        last = s;
+      }
+    }
+
+    pairCodes(len, code);
+    w.acc = 0;
+    w.nbits = 0;
+    w.buf = out + hdr;
+    w.pos = 0;
+    for (i = 0; i + 1 < n; i += 2) {
+      s = p[i] << BITSPERBYTE | p[i + 1];
+      putBits(&w, code[s], len[s]);
+    }
+    flushBits(&w);
+  }
+  else {
+    size = 0;
+  }
+
+  freeMem(freqs);
+  freeMem(code);
+  freeMem(len);
+  return size;
+}
+
+size_t decodePairBlock(const unsigned char *p, size_t n, unsigned char *out,
+  size_t len)
+{
+  /* Decodes the BLOCKPAIR block of n bytes at p, after its header, into
+   * the len bytes at out */
+  decodePairs(p, n, len, 0, 0, out, len);
+  return len;
+}
+
+size_t readPairTable(const unsigned char *p, size_t n, size_t len, 
+  unsigned char *lens)
+{
+  /* Reads the code length of every pair from the BLOCKPAIR block of n
+   * bytes at p, which holds len chars, and returns where its bitstream
+   * starts */
+  size_t pos = BLOCKHDRLEN + len % 2, g;
+  unsigned long kraft = 0;
+  int nsyms, k, s = -1, l;
+
+  if (pos + NPAIRSHDRLEN > n) {
+    corruptPairs();
+  }
+  nsyms = readUint(p + pos, NPAIRSHDRLEN);
+  pos += NPAIRSHDRLEN;
+  if (nsyms < 1 || nsyms > PAIRSYMS) {
+    corruptPairs();
+  }
+  memset(lens, 0, PAIRSYMS);
+  for (k = 0; k < nsyms; k++) {
+    g = readGap(p, n, &pos);
+    if (g >= (size_t)(PAIRSYMS - 1 - s) || pos >= n) {
+      corruptPairs();
+    }
+    s += g + 1;
+    l = p[pos++];
+    if (l < 1 || l > PAIRMAXCODELEN) {
+      corruptPairs();
+    }
+    lens[s] = l;
+    kraft += 1UL << (PAIRMAXCODELEN - l);
+  }
+  /* the lengths must leave room for every code */
+  if (kraft > 1UL << PAIRMAXCODELEN) {
+    corruptPairs();
+  }
+  return pos;
+}
+
+void decodePairs(const unsigned char *p, size_t n, size_t len, size_t at,
+  uint64_t bitoff, unsigned char *out, size_t count)
+{
+  /* Decodes the count chars from at, which is even, of the BLOCKPAIR
+   * block of n bytes at p holding len chars, whose code starts bitoff
+   * bits into the bitstream.  A last odd char comes from the header, and
+   * if count stops halfway through a pair only its first char is kept. */
+  unsigned char *lens = (unsigned char *)allocMem(PAIRSYMS);
+  uint32_t *code = (uint32_t *)allocMem(PAIRSYMS * sizeof(uint32_t));
+  uint32_t *dt, e;
+  size_t pos = readPairTable(p, n, len, lens), i, m;
+  bitReader r;
+  int l;
+
+  /* m chars come from pairs, the rest from the header */
+  m = at + count > len - len % 2 ? len - len % 2 - at : count;
+  if (m < count) {
+    out[count - 1] = p[BLOCKHDRLEN];
+  }
+  pairCodes(lens, code);
+  dt = buildPairTable(lens, code);
+  seekReader(&r, p + pos, n - pos, bitoff);
+  for (i = 0; i < m; i += 2) {
+    if (r.nbits < PAIRMAXCODELEN) {
+      refillBits(&r);
+    }
+    e = dt[r.acc >> (ACCBITS - PAIRTABLEBITS)];
+    if (e & LINKFLAG) {
+      r.acc <<= PAIRTABLEBITS;
+      r.nbits -= PAIRTABLEBITS;
+      e = dt[(e >> ENTRYSHIFT) + (r.acc >> (ACCBITS - (e & LENMASK)))];
+    }
+    l = e & LENMASK;
+    if (l == 0) {
+      huffError("invalid code in compressed data");
+      fail();
+    }
+    r.acc <<= l;
+    r.nbits -= l;
+    if (r.nbits < 0) {
+      huffError("compressed data is truncated");
+      fail();
+    }
+    out[i] = e >> (ENTRYSHIFT + BITSPERBYTE);
+    if (i + 1 < m) {
+      out[i + 1] = e >> ENTRYSHIFT;
+    }
+  }
+
+  freeMem(lens);
+  freeMem(code);
+  freeMem(dt);
+}
+
+int pairLengths(const uint64_t *freqs, unsigned char *len)
+{
+  /* Fills in the code length of every pair, 0 for those not used, and
+   * returns how many have codes.  A leaf's depth is one more than its
+   * parent's, and every parent comes after its children, so one pass
+   * down from the root gives every length.  Codes longer than
+   * PAIRMAXCODELEN are shortened as in limitCodeLengths(). */
+  tree tr;
+  int *depth, *count;
+  int i, j, l, n = 0, extra, maxl = 0;
+
+  for (i = 0; i < PAIRSYMS; i++) {
+    n += freqs[i] != 0;
+  }
+  /* a tree needs 2 leaves, so unused pairs make up the numbers */
+  extra = n < 2 ? 2 - n : 0;
+  n += extra;
+  tr.len = n;
+  tr.a = (node *)allocMem((2 * n - 1) * sizeof(node));
+  for (i = 0, j = 0; i < PAIRSYMS; i++) {
+    if (freqs[i] != 0) {
+      setNode(&tr.a[j++], i, freqs[i], NOCHILD, NOCHILD);
+    }
+    else if (extra > 0) {
+      setNode(&tr.a[j++], i, 0, NOCHILD, NOCHILD);
+      extra--;
+    }
+  }
+  qsort(tr.a, n, sizeof(node), nodeComp);
+  tr.root = populateTree(&tr);
+
+  depth = (int *)allocMem((2 * n - 1) * sizeof(int));
+  count = (int *)allocMem((n + 1) * sizeof(int));
+  memset(count, 0, (n + 1) * sizeof(int));
+  depth[tr.root] = 0;
+  for (i = tr.root; i >= n; i--) {
+    depth[tr.a[i].left] = depth[tr.a[i].right] = depth[i] + 1;
+  }
+  for (i = 0; i < n; i++) {
+    count[depth[i]]++;
+    maxl = depth[i] > maxl ? depth[i] : maxl;
+  }
+
+  for (l = maxl; l > PAIRMAXCODELEN; l--) {
+    while (count[l] > 0) {
+      for (j = l - 2; count[j] == 0; j--) {
+        ;
+      }
+      count[l] -= 2;
+      count[l - 1]++;
+      count[j + 1] += 2;
+      count[j]--;
+    }
+  }
+  /* the leaves are sorted rarest first, so they take the longest
+   * codes */
+  memset(len, 0, PAIRSYMS);
+  for (i = 0, l = maxl; i < n; i++) {
+    while (count[l] == 0) {
+      l--;
+    }
+    count[l]--;
+    len[tr.a[i].c] = l;
+  }
+
+  freeMem(depth);
+  freeMem(count);
+  freeMem(tr.a);
+  return n;
+}
+
+void pairCodes(unsigned char *len, uint32_t *code)
+{
+  /* canonical codes, as assignCanonicalCodes() */
+  int i, l;
+  int count[PAIRMAXCODELEN + 1] = {0};
+  uint32_t next[PAIRMAXCODELEN + 1];
+
+  for (i = 0; i < PAIRSYMS; i++) {
+    count[len[i]]++;
+  }
+  count[0] = 0;
+  next[0] = 0;
+  for (l = 1; l <= PAIRMAXCODELEN; l++) {
+    next[l] = (next[l - 1] + count[l - 1]) << 1;
+  }
+  for (i = 0; i < PAIRSYMS; i++) {
+    if (len[i] != 0) {
+      code[i] = next[len[i]]++;
+    }
+  }
+}
+
+uint32_t *buildPairTable(unsigned char *len, uint32_t *code)
+{
+  /* As buildDecodeTable(), with the pair in place of the char in
+   * each entry.  The secondary tables are sized once the longest code under
+   * each prefix is known, so the table is allocated, and freed by the
+   * caller. */
+  int sub[1 << PAIRTABLEBITS] = {0};
+  size_t size = 1 << PAIRTABLEBITS;
+  uint32_t *dt, e;
+  int i, l, p, extra;
+
+  for (i = 0; i < PAIRSYMS; i++) {
+    l = len[i];
+    if (l > PAIRTABLEBITS) {
+      p = code[i] >> (l - PAIRTABLEBITS);
+      if (l - PAIRTABLEBITS > sub[p]) {
+        sub[p] = l - PAIRTABLEBITS;
+      }
+    }
+  }
+  for (p = 0; p < 1 << PAIRTABLEBITS; p++) {
+    size += sub[p] != 0 ? (size_t)1 << sub[p] : 0;
+  }
+  dt = (uint32_t *)allocMem(size * sizeof(uint32_t));
+  memset(dt, 0, size * sizeof(uint32_t));
+  for (p = 0, size = 1 << PAIRTABLEBITS; p < 1 << PAIRTABLEBITS; p++) {
+    if (sub[p] != 0) {
+      dt[p] = ((uint32_t)size << ENTRYSHIFT) | LINKFLAG | sub[p];
+      size += (size_t)1 << sub[p];
+    }
+  }
+
+  for (i = 0; i < PAIRSYMS; i++) {
+    l = len[i];
+    if (l == 0) {
+      continue;
+    }
+    if (l <= PAIRTABLEBITS) {
+      fillEntries(dt + (code[i] << (PAIRTABLEBITS - l)),
+        1 << (PAIRTABLEBITS - l), ((uint32_t)i << ENTRYSHIFT) | l);
+    }
+    else {
+      extra = l - PAIRTABLEBITS;
+      e = dt[code[i] >> extra];
+      p = (code[i] & ((1 << extra) - 1)) << ((e & LENMASK) - extra);
+      fillEntries(dt + (e >> ENTRYSHIFT) + p,
+        1 << ((e & LENMASK) - extra), ((uint32_t)i << ENTRYSHIFT) | extra);
+    }
+  }
+  return dt;
+}
+
+int gapBytes(size_t g)
+{
+  int n = 1;
+
+  for (; g >= 1 << GAPBITS; g >>= GAPBITS) {
+    n++;
+  }
+  return n;
+}
+
+int writeGap(unsigned char *p, size_t g)
+{
+  /* low 7 bits first, and returns the number of bytes written */
+  int n = 0;
+
+  for (; g >= 1 << GAPBITS; g >>= GAPBITS) {
+    p[n++] = (g & ((1 << GAPBITS) - 1)) | (1 << GAPBITS);
+  }
+  p[n++] = g;
+  return n;
+}
+
+size_t readGap(const unsigned char *p, size_t n, size_t *pos)
+{
+  size_t g = 0;
+  int i;
+
+  for (i = 0; i < MAXGAPLEN; i++) {
+    if (*pos >= n) {
+      corruptPairs();
+    }
+    g |= (size_t)(p[*pos] & ((1 << GAPBITS) - 1)) << (i * GAPBITS);
+    if ((p[(*pos)++] & (1 << GAPBITS)) == 0) {
+      return g;
+    }
+  }
+  corruptPairs();
+  return 0;
+}
+
+void corruptPairs(void)
+{
+  huffError("corrupt pair table");
+  fail();
+}
@@ -0,0 +1,226 @@
+/* huffpipe.c
+ *
+ * Part of libhuff (see huff.h): the pipeline that streams are compressed
+ * and decompressed through, so that reading, coding and writing all go
+ * on at once.  Reading a pipe or a network disk can take as long as
+ * coding what it brings, and done one after the other they would each
+ * wait on the other.
+ *
+ * A reader thread reads blocks into a ring of fixed-size slots, a pool
+ * of worker threads codes them, and the calling thread writes them out
+ * in order and hands the slot back to the reader.  The ring is
+ * 2 * threads + 2 slots, so the reader can be a slot ahead and the
+ * writer a slot behind while every worker is busy, and its buffers are
+ * allocated once and reused for the whole stream.  When the ring is
+ * full the reader waits, so memory stays the same however long the
+ * stream is.
+ *
+ * Errors in the reader and workers can't jump back to a huffCatch set up
+ * on the calling thread, so with one set up, or if the threads can't be
+ * started, each block is read, coded and written on the calling thread
+ * in turn instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "huff.h"
+
+void runPipe(pipeJob *job)
+{
+  pthread_t reader, tid[MAXTHREADS];
+  int i, started = 0, last;
+  long seq;
+  pipeSlot *s;
+
+  job->nslots = 2 * job->threads + 2;
+  job->slots = (pipeSlot *)allocMem(job->nslots * sizeof(pipeSlot));
+  for (i = 0; i < job->nslots; i++) {
+    job->slots[i].in = (unsigned char *)allocMem(job->insize);
+    job->slots[i].out = (unsigned char *)allocMem(job->outsize);
+    job->slots[i].done = 0;
+  }
+  job->nread = job->nstarted = job->nwritten = 0;
+  job->ended = 0;
+  pthread_mutex_init(&job->lock, NULL);
+  pthread_cond_init(&job->cond, NULL);
+
+  if (getCatch() != NULL
+    || pthread_create(&reader, NULL, pipeReader, job) != 0) {
+    s = &job->slots[0];
+    while (job->read(job, s)) {
+      job->work(job, s);
+      job->write(job, s);
+    }
+  }
+  else {
+    for (i = 0; i < job->threads; i++) {
+      if (pthread_create(&tid[started], NULL, pipeWorker, job) == 0) {
+        started++;
+      }
+    }
+    for (seq = 0;; seq++) {
+      s = &job->slots[seq % job->nslots];
+      pthread_mutex_lock(&job->lock);
+      while (!(seq < job->nread && (s->done || started == 0))
+        && !(job->ended && seq == job->nread)) {
+        pthread_cond_wait(&job->cond, &job->lock);
+      }
+      last = seq == job->nread;
+      pthread_mutex_unlock(&job->lock);
+      if (last) {
+        break;
+      }
+
+      if (started == 0) {
+        job->work(job, s);
+      }
+      job->write(job, s);
+
+      pthread_mutex_lock(&job->lock);
+      s->done = 0;
+      job->nwritten++;
+      pthread_cond_broadcast(&job->cond);
+      pthread_mutex_unlock(&job->lock);
+    }
+    pthread_join(reader, NULL);
+    for (i = 0; i < started; i++) {
+      pthread_join(tid[i], NULL);
+    }
+  }
+
+  pthread_mutex_destroy(&job->lock);
+  pthread_cond_destroy(&job->cond);
+  for (i = 0; i < job->nslots; i++) {
+    freeMem(job->slots[i].in);
+    freeMem(job->slots[i].out);
+  }
+  freeMem(job->slots);
+}
+
+void *pipeReader(void *arg)
+{
+  /* Reads each block into the next slot once the writer is done with
+   * it, until the input ends */
+  pipeJob *job = (pipeJob *)arg;
+  pipeSlot *s;
+  long seq;
+  int more;
+
+  for (seq = 0;; seq++) {
+    pthread_mutex_lock(&job->lock);
+    while (seq >= job->nwritten + job->nslots) {
+      pthread_cond_wait(&job->cond, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    s = &job->slots[seq % job->nslots];
+    more = job->read(job, s);
+
+    pthread_mutex_lock(&job->lock);
+    if (more) {
+      job->nread++;
+    }
+    else {
+      job->ended = 1;
+    }
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+    if (!more) {
+      return NULL;
+    }
+  }
+}
+
+void *pipeWorker(void *arg)
+{
+  /* Codes the next block that has been read, until the reader has
+   * ended and none are left */
+  pipeJob *job = (pipeJob *)arg;
+  pipeSlot *s;
+  long seq;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    while (job->nstarted == job->nread && !job->ended) {
+      pthread_cond_wait(&job->cond, &job->lock);
+    }
+    if (job->nstarted == job->nread) {
+      pthread_mutex_unlock(&job->lock);
+      return NULL;
+    }
+    seq = job->nstarted++;
+    pthread_mutex_unlock(&job->lock);
+
+    s = &job->slots[seq % job->nslots];
+    job->work(job, s);
+
+    pthread_mutex_lock(&job->lock);
+    s->done = 1;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+  }
+}
+
+int readRawBlock(pipeJob *job, pipeSlot *s)
+{
+  /* a whole block of input, or what is left of it */
+  s->inlen = fread(s->in, 1, job->insize, job->in);
+  if (s->inlen == 0 && ferror(job->in)) {
+    huffError("failed to read input");
+    fail();
+  }
+  return s->inlen > 0;
+}
+
+void encodeSlot(pipeJob *job, pipeSlot *s)
+{
+  huffStream *hs = job->stream;
+
+  s->outlen = encodeBlock(s->in, s->inlen, hs->maxcodelen, hs->streams,
+    hs->pairs, hs->context, s->out);
+}
+
+void writeCodedBlock(pipeJob *job, pipeSlot *s)
+{
+  writeStreamBlock(job->stream, s->out, s->outlen, s->inlen);
+}
+
+int readCodedBlock(pipeJob *job, pipeSlot *s)
+{
+  /* the next block, skipping any seek table, until the end block */
+  size_t len;
+
+  readBytes(job->in, s->in, BLOCKHDRLEN);
+  while (s->in[0] == BLOCKSEEK) {
+    /* the seek table isn't needed either */
+    skipBytes(job->in, readUint(s->in + 5, 4));
+    readBytes(job->in, s->in, BLOCKHDRLEN);
+  }
+  if (s->in[0] == BLOCKEND) {
+    return 0;
+  }
+  len = readUint(s->in + 5, 4);
+  if (len > job->insize - BLOCKHDRLEN) {
+    huffError("corrupt block header");
+    fail();
+  }
+  readBytes(job->in, s->in + BLOCKHDRLEN, len);
+  s->inlen = BLOCKHDRLEN + len;
+  return 1;
+}
+
+void decodeSlot(pipeJob *job, pipeSlot *s)
+{
+  s->outlen = decodeBlock(s->in, s->inlen, s->out, job->outsize);
+}
+
+void writeRawBlock(pipeJob *job, pipeSlot *s)
+{
+  if (fwrite(s->out, 1, s->outlen, job->out) != s->outlen) {
+    huffError("failed to write output");
+    fail();
+  }
+}
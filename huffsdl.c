@@ -1,538 +1,404 @@
-/* huffsdl.c
- * 
- * Function: builds a binary huffman tree from the ASCII-encoded text file
- * given in argv[1], and draws the tree to an SDL window.
- * Usage: filename path/to/textfile
- * Make with makefile command 'make'.
- * 
- * See Huffman.c and huffvis.c for information about the shared processes.
- * The int array in huffvis.c has been converted to a char array to work
- * with Neill_SDL_DrawString.  It is read into an alloced buffer of size
- * d.xlen+1 one line at a time.  It no longer contains branch characters
- * and the parent node char is only left in as a marker for the line
- * drawing function (which checks the contents of the char grid for non-
- * empty spots).  The parent node is removed as the grid is read into
- * the buffer.  The colour of each node is a function of its height.
- * The window will close on any keypress or mouse click.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <string.h>
-#include "neillsdl2.h"
-
-#define ASIZE   128  /* size of array indexed by ASCII chars */
-#define XOFFSET   2  /* offsets for printing binary tree */
-#define YOFFSET   3   
-#define PNODE   '#'  /* characters for printing binary tree */
-#define EMPTY   ' '
-
-#define FNTFILE   "m7fixed.fnt"
-#define TOPOFFSET FNTHEIGHT * 3 /* space at top of screen for file info etc*/
-#define PADDING   3 /* extra space around node char*/
-#define NRADIUS   (FNTHEIGHT / 2) + PADDING /* radius of node */
-#define NODEGREEN    120 /* colour values for nodes - red varies by depth*/
-#define NODEBLUE    120
-
-typedef struct node {
-  int freq;
-  int c;
-  struct node *left;
-  struct node *right;
-} node;
-
-typedef struct nodeIndex {
-  node **a;
-  int len;
-} nodeIndex;
-
-typedef struct display {
-  char *grid;
-  size_t xlen, ylen;
-} display;
-
-typedef struct buffer {
-  char *str;
-  short size;
-} buffer;
-
-typedef struct colour {
-  uint8_t red, green, blue;
-} colour;
-
-/* drawing functions */
-void handleDisplay(node *n, display *d, char **argv);
-void drawTree(node *n, display *d, SDL_Simplewin *sw, 
-  fntrow fontdata[FNTCHARS][FNTHEIGHT]);
-void drawTreeRecursive(node *n, display *d, SDL_Simplewin *sw, 
-  int y, int x);
-int  getRightBranchOffset(node *n);
-void drawInfo(SDL_Simplewin *sw, fntrow fontdata[FNTCHARS][FNTHEIGHT], 
-  char **argv);
-void drawBranches(node *n, display *d, SDL_Simplewin *sw, int x, int y);
-void drawLeftBranch(int x, int y, SDL_Simplewin *sw );
-void drawRightBranch(int x, int y, display *d, SDL_Simplewin *sw );
-void drawNode(int x, int y, SDL_Simplewin *sw );
-void drawDisplayGrid(display *d, SDL_Simplewin *sw, 
-  fntrow fontdata[FNTCHARS][FNTHEIGHT]);
-buffer createBuffer(int size);
-int  treeHeight(node *n);
-void initDisplayGrid(display *d, node *root);
-int  setGridHeight(node *n, int height, int maxheight);  
-  
-/* Tree-building functions */
-int  *getFreqsFromFile(int argc, char **argv, int *arr);
-int  calcNodeCnt(int *a);
-node *createNode(int c, int freq, node *left, node *right);
-node **createNodeIndex(int *a, int len);
-int  nodeComp(const void * a, const void * b);
-node *populateTree(nodeIndex *index);
-int  getInsertionPoint(int key, nodeIndex *index, int start);
-
-int  min(int a, int b);
-int  max(int a, int b);
-void freeNodes(node *n);
-
-int main(int argc, char **argv)
-{
-  int ascii[ASIZE] = {0};
-  nodeIndex index = {NULL, 0};
-  node *root;
-  display d;
-
-  getFreqsFromFile(argc, argv, ascii);
-  index.len = calcNodeCnt(ascii);
-  index.a = createNodeIndex(ascii, index.len);
-  qsort(index.a, index.len, sizeof(node *), nodeComp);
-  root = populateTree(&index);
-  handleDisplay(root, &d, argv);
-  free(index.a);
-  freeNodes(root);
-  free(d.grid);
- 
-  return 0;
-}
-
-void handleDisplay(node *n, display *d, char **argv)
-{
-  SDL_Simplewin sw;
-  fntrow fontdata[FNTCHARS][FNTHEIGHT];
-  
-  Neill_SDL_Init(&sw);
-  Neill_SDL_ReadFont(fontdata, FNTFILE);
-  drawTree(n, d, &sw, fontdata);
-  drawInfo(&sw, fontdata, argv);
-
-  SDL_RenderPresent(sw.renderer);
-  SDL_UpdateWindowSurface(sw.win);
-  
-  do {
-    Neill_SDL_Events(&sw);
-  }
-  while (!sw.finished);
-
-  SDL_Quit(); 
-}
-
-void drawTree(node *n, display *d, SDL_Simplewin *sw, 
-  fntrow fontdata[FNTCHARS][FNTHEIGHT])
-{
-  initDisplayGrid(d, n);
-  
-  drawTreeRecursive(n, d, sw, 0 ,0);
-
-  /* This blend mode stops the nodes and branches being covered 
-   * over by the text layer. */
-  SDL_SetRenderDrawBlendMode(sw->renderer, SDL_BLENDMODE_ADD);   
-  drawDisplayGrid(d, sw, fontdata);
-}
-
-void drawInfo(SDL_Simplewin *sw, fntrow fontdata[FNTCHARS][FNTHEIGHT], 
-  char **argv)
-{
-  char s[WWIDTH / FNTWIDTH] = "";
-
-  strncpy(s, argv[1], WWIDTH / FNTWIDTH);
-  /* doesn't bother loading any more than can fit on the screen */
-  
-  Neill_SDL_DrawString(sw, fontdata, "Huffman tree", 0, 0); 
-  Neill_SDL_DrawString(sw, fontdata, s, 0, FNTHEIGHT);
-}
-
-void drawTreeRecursive(node *n, display *d, SDL_Simplewin *sw, 
-  int y, int x)
-{
-  /* prints the tree to a 1D array (indexed as 2D) */
-  static int xmax = 0;
-  int dx = 0;
-
-  if (n == NULL) {
-    return;
-  }
-  
-  if (x > xmax) {
-    xmax = x;
-  }
-
-  if (treeHeight(n->right) > 0) {
-    dx = getRightBranchOffset(n->left);
-  }
-
-  d->grid[(y * d->xlen) + x] = n->c;
-  drawTreeRecursive(n->left, d, sw, y + YOFFSET, x);
-  drawTreeRecursive(n->right, d, sw, y, min(x + dx,xmax) + XOFFSET);
-  drawBranches(n, d, sw, x, y);
-}
-
-int getRightBranchOffset(node *n)
-{
-  /* calculates the draw distance between a node and its right child. */
-  int cnt = 0;
-
-  if (n == NULL) {
-    return 0;
-  }
-  
-  cnt = getRightBranchOffset(n->left) 
-      + getRightBranchOffset(n->right);
-  
-  if (n->right != NULL) {
-    return cnt + XOFFSET;
-  }
-  else {
-    return 0;
-  }
-}
-
-void drawBranches(node *n, display *d, SDL_Simplewin *sw, int x, int y)
-{
-  int nodeheight = min(treeHeight(n) + 1,UINT8_MAX);
-  colour nodeclr = {0 , NODEGREEN, NODEBLUE };
-  
-  nodeclr.red = UINT8_MAX - UINT8_MAX / nodeheight;
-  Neill_SDL_SetDrawColour(sw, nodeclr.red, 
-    nodeclr.blue, nodeclr.green);
-  drawNode(x, y, sw);
-  
-  if (n->left != NULL) {
-    nodeclr.red = UINT8_MAX - UINT8_MAX / (nodeheight - 1);
-    Neill_SDL_SetDrawColour(sw, nodeclr.red, 
-      nodeclr.blue, nodeclr.green);    
-    drawLeftBranch(x, y, sw);
-  }
-
-  if (n->right != NULL) {
-    nodeclr.red = UINT8_MAX - UINT8_MAX / (nodeheight - 1);
-    Neill_SDL_SetDrawColour(sw, nodeclr.red, 
-      nodeclr.blue, nodeclr.green);   
-    drawRightBranch(x, y, d, sw);
-  }
-
-}
-
-void drawLeftBranch(int x, int y, SDL_Simplewin *sw )
-{
-  int SDLx = (x + 1) * FNTWIDTH + FNTWIDTH / 2;
-  int SDLy = (y + 1) * FNTHEIGHT  + PADDING + TOPOFFSET;
-  int SDLdy = YOFFSET * FNTHEIGHT - FNTHEIGHT - PADDING * 2;
-  
-  if (SDL_RenderDrawLine(sw->renderer, 
-    SDLx, SDLy, SDLx, SDLy + SDLdy ) != 0) {
-      fprintf(stderr, "\nFailed to draw line:  %s\n", SDL_GetError());
-      SDL_Quit();
-      exit(1);
-    }
-}
-
-void drawRightBranch(int x, int y, display *d, SDL_Simplewin *sw )
-{
-  int i = 0, SDLdx;
-  int SDLx = (x + 2)* FNTWIDTH + PADDING;
-  int SDLy = y * FNTHEIGHT + FNTHEIGHT / 2 + TOPOFFSET;   
-  
-  while (d->grid[(y * d->xlen) + x + i + 1] == EMPTY) {
-    i++;
-  }
-  SDLdx = i * FNTWIDTH - PADDING * 2;
-  
-  if (SDL_RenderDrawLine(sw->renderer, 
-    SDLx, SDLy, SDLx + SDLdx, SDLy) != 0) {
-      fprintf(stderr, "\nFailed to draw line:  %s\n", SDL_GetError());
-      SDL_Quit();
-      exit(1);
-    } 
-}
-
-void drawNode(int x, int y, SDL_Simplewin *sw )
-{
-  int SDLx = (x + 1) * FNTWIDTH + FNTWIDTH / 2;
-  int SDLy = y * FNTHEIGHT + FNTHEIGHT / 2  + TOPOFFSET;
-  
-  Neill_SDL_RenderFillCircle(sw->renderer, SDLx, SDLy, NRADIUS);
-}
-
-void drawDisplayGrid(display *d, SDL_Simplewin *sw, 
-  fntrow fontdata[FNTCHARS][FNTHEIGHT])
-{
-  unsigned int i, x = 0, y;
-  buffer b = createBuffer(d->xlen);
-  
-  for (y = 0; y < d->ylen; y++) {
-    strncpy(b.str,  d->grid + (y * d->xlen), d->xlen);
-    b.str[d->xlen - 1] = '\0';
-    for (i = 0; b.str[i]; i++) {
-      if (b.str[i] == PNODE) {
-        b.str[i] = EMPTY; /* doesn't display the parent node char */
-      } 
-    }
-    Neill_SDL_DrawString(sw, fontdata, b.str, x, y * FNTHEIGHT + TOPOFFSET);
-    memset(b.str,'\0',strlen(b.str));
-  }
-  free(b.str);
-}
-
-void initDisplayGrid(display *d, node *root)
-{
-  unsigned int x,y;
-  
-  d->ylen = setGridHeight(root, 0, 0) + YOFFSET;
-  d->xlen = getRightBranchOffset(root) + XOFFSET;
-  
-  d->grid = (char *)malloc(sizeof(char) * d->xlen * d->ylen);
-  if (d->grid == NULL) {
-    fprintf(stderr,"ERROR: grid malloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-  
-  for (y = 0; y < d->ylen; y++) {
-    for (x = 0; x < d->xlen; x++) {
-      d->grid[(y * d->xlen) + x] = EMPTY;
-    }
-  }
-}
-
-buffer createBuffer(int size)
-{
-  buffer b;
-
-  b.str = (char *)calloc(size + 1,sizeof(char));
-  if (b.str == NULL) {
-    fprintf(stderr,"ERROR: buffer calloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-
-  b.size = size + 1;
-
-  return b;
-}
-
-int setGridHeight(node *n, int height, int maxheight)
-{
-  /* Finds the route with most left branches from n down */
-  if (n == NULL) {
-    return 0;
-  }
-
-  maxheight = max(
-    setGridHeight(n->left, height + YOFFSET, maxheight),
-    setGridHeight(n->right, height,  maxheight));
-  
-  if (height > maxheight) {
-    maxheight = height;
-  } 
-
-  return maxheight;
-}
-
-int treeHeight(node *n)
-{
-  int lh, rh;
-  if (n == NULL) {
-    return -1;
-  }
-
-  lh = treeHeight(n->left);
-  rh = treeHeight(n->right);
-
-  if (lh > rh) {
-    return lh + 1;
-  }
-  else {
-    return rh + 1;
-  }
-}
-
-int *getFreqsFromFile(int argc, char **argv, int *a)
-{
-  FILE *file = fopen(argv[1], "r");
-  int c;
-
-  if (file == NULL) {
-    fprintf(stderr, "Error opening file - check name and directory.\n");
-    exit(1);
-  }
-  if (argc != 2) {
-    fprintf(stderr, "Invalid number of arguments supplied.\n");
-    fclose(file);
-    exit(1);
-  }
-
-  while((c = fgetc(file)) != EOF) {
-    if (isalpha(c)) {
-      c = toupper(c);
-      a[c]++;
-    }
-  }
-
-  fclose(file);
-  return a;
-}
-
-node *createNode(int c, int freq, node *left, node *right)
-{
-  node *p;
-
-  p = (node *)malloc(sizeof(node));
-  if (p == NULL) {
-    fprintf(stderr,"ERROR: node malloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-  p->freq = freq;
-  p->c = c;
-  p->left = left;
-  p->right = right;
-
-  return p;
-}
-
-node **createNodeIndex(int *a, int len)
-{
-  int i, j;
-  node **na = (node **)calloc(len,sizeof(node *));
-
-  if (na == NULL) {
-    fprintf(stderr,"ERROR: index alloc failed\n");
-    exit(EXIT_FAILURE);
-  }
-
-  for (i = 0, j = 0; i < ASIZE; i++) {
-    if (a[i]!= 0) {
-      na[j] = createNode(i, a[i], NULL, NULL);
-      j++;
-    }
-  }
-
-  return na;
-}
-
-int calcNodeCnt(int *a)
-{
-  int i, cnt = 0;
-
-  for (i = 0; i < ASIZE; i++) {
-    if (a[i] != 0) {
-      cnt++;
-    }
-  }
-  
-  if (cnt < 2) {
-    fprintf(stderr,"ERROR: too few nodes to build tree\n");
-    exit(EXIT_FAILURE); 
-  }
-
-  return cnt;
-}
-
-int nodeComp(const void * a, const void * b)
-{
-  const node **n1 = (const node **)a;
-  const node **n2 = (const node **)b;
-
-  return (int)((*n1)->freq - (*n2)->freq);
-}
-
-node *populateTree(nodeIndex *index)
-{
-  /* Sorts the array each time using a binary search to find the
-  * insertion point, then memmove to create a space in the array
-  * for the insertion.
-  *
-  * See hufftest.c for testing.  For different tree-building methods, 
-  * (with a test case of 5000 nodes, starting from a sorted 
-  * initial state, no optimisation flags)
-  * representative results are:
-  * time spent to execute qsort: 0.810000s
-  * time spent to execute binary search + memmove: 0.010000s
-  * time spent to execute insertion sort: 0.170000s
-  */
-  int insertpoint, newfreq, lchild, rchild, start = 0;
-  node *parent;
-
-  for (start = 0; start < index->len - 1; start++) {
-    lchild = start; /* lchild and rchild are purely for readability */
-    rchild = start + 1;
-    newfreq = index->a[lchild]->freq + index->a[rchild]->freq;
-    parent = createNode(PNODE, newfreq, index->a[lchild], index->a[rchild]);
-
-    insertpoint = getInsertionPoint(parent->freq, index, start);
-    index->a[lchild] = index->a[rchild] = NULL;
-
-    if (insertpoint > start + 1) {
-      /* if insertpoint is not at beginnning, create room for new node */
-      memmove(index->a, index->a + 1, insertpoint * sizeof(node *));
-    }
-    index->a[insertpoint] = parent;
-  }
-  return index->a[index->len - 1]; /* returns pointer to root node */
-}
-
-int getInsertionPoint(int key, nodeIndex *index, int start)
-{
-  int end = index->len - 1, mid;
-
-  while (start <= end) {
-    mid = (start + end) / 2;
-    if (key > index->a[mid]->freq) {
-      start = mid + 1;
-    }
-    else if (key < index->a[mid]->freq){
-      end = mid - 1;
-    }
-    else {
-      return mid;
-    }
-  }
-  return start - 1; /* still need an insertion point,
-  even if no match was found. */
-}
-
-int min(int a, int b)
-{
-  if (a > b) {
-    return b;
-  }
-  else {
-    return a;
-  }
-}
-
-int max(int a, int b)
-{
-  if (a < b) {
-    return b;
-  }
-  else {
-    return a;
-  }
-}
-
-void freeNodes(node *n)
-{
-  if (n == NULL) {
-    return;
-  }
-  freeNodes(n->left);
-  freeNodes(n->right);
-  free(n);
+/* huffsdl.c
+ * 
+ * Function: builds a binary huffman tree from the ASCII-encoded text file
+ * given in argv[1], and draws the tree to an SDL window.
+ * Usage: filename [-a] path/to/textfile
+ * Make with makefile command 'make huffsdl'.
+ * 
+ * The tree is built by libhuff: see hufftree.c for how it is stored in
+ * a single array of nodes, and huffvis.c for how it is laid out.  Only
+ * the letters are counted, with lower case added to upper case, unless
+ * -a is given, when every byte value is, and those the font has no char
+ * for are drawn as '.'.
+ *
+ * The layout is worked out once by libhuff, before anything is drawn,
+ * on the same character grid as huffvis.c (see huffgrid.c).  Only the
+ * grid position of each node is kept, so memory goes with the number of
+ * nodes rather than the size of the grid, and each redraw skips the
+ * nodes that can't be seen.  The colour of each node is a function of
+ * its height.  The info panel
+ * shows the number of bytes needed to encode the file, read from the
+ * same table of codes that huffman.c encodes with.
+ *
+ * The arrow keys or dragging with the mouse pan around the tree, + and -
+ * or the mouse wheel zoom in and out, and Home goes back to the start.
+ * The window closes on q, Escape or closing it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+#include "neillsdl2.h"
+
+#define XOFFSET   2  /* offsets for printing binary tree */
+#define YOFFSET   3   
+#define UNPRINTABLE '.' /* drawn for chars the font doesn't have */
+
+#define FNTFILE   "m7fixed.fnt"
+#define TOPOFFSET FNTHEIGHT * 3 /* space at top of screen for file info etc*/
+#define PADDING   3 /* extra space around node char*/
+#define NRADIUS   (FNTHEIGHT / 2) + PADDING /* radius of node */
+#define NODEGREEN    120 /* colour values for nodes - red varies by depth*/
+#define NODEBLUE    120
+#define PANSTEP   4 /* arrow keys pan by 1/PANSTEP of the window */
+#define ZOOMSTEP  1.25 /* each zoom in or out scales by this */
+#define MINZOOM   0.05
+#define MAXZOOM   4.0
+
+typedef struct view {
+  int x, y;    /* tree pixel at the top left of the drawing area */
+  int top;     /* height of the info panel, in zoomed pixels */
+  double zoom;
+} view;
+
+typedef struct colour {
+  uint8_t red, green, blue;
+} colour;
+
+/* drawing functions */
+void handleDisplay(tree *tr, uint64_t *a, char *name);
+int  handleEvents(SDL_Simplewin *sw, view *v);
+void zoomView(view *v, double zoom);
+void clampView(view *v, treeLayout *l);
+void redraw(tree *tr, treeLayout *l, view *v, SDL_Simplewin *sw, 
+  fntrow fontdata[FNTCHARS][FNTHEIGHT], char *name, unsigned long bytes);
+void drawTree(tree *tr, treeLayout *l, view *v, SDL_Simplewin *sw, 
+  fntrow fontdata[FNTCHARS][FNTHEIGHT]);
+int  isVisible(tree *tr, treeLayout *l, view *v, int n);
+void drawInfo(SDL_Simplewin *sw, fntrow fontdata[FNTCHARS][FNTHEIGHT], 
+  char *name, unsigned long bytes, double zoom);
+unsigned long encodedBytes(tree *tr, uint64_t *a);
+void drawBranches(tree *tr, treeLayout *l, view *v, int n, SDL_Simplewin *sw);
+void drawLeftBranch(int x, int y, view *v, SDL_Simplewin *sw);
+void drawRightBranch(int x, int y, int xr, view *v, SDL_Simplewin *sw);
+void drawNode(int x, int y, view *v, SDL_Simplewin *sw);
+void drawLeaf(int x, int y, int c, view *v, SDL_Simplewin *sw,
+  fntrow fontdata[FNTCHARS][FNTHEIGHT]);
+
+int  min(int a, int b);
+int  max(int a, int b);
+
+int main(int argc, char **argv)
+{
+  uint64_t freqs[ASIZE] = {0};
+  tree tr = {NULL, 0, 0};
+  char *name;
+  int all;
+
+  name = parseTreeArgs(argc, argv, &all);
+  countLetters(name, all, freqs);
+  buildTree(freqs, &tr);
+  handleDisplay(&tr, freqs, name);
+  freeMem(tr.a);
+
+  return 0;
+}
+
+void handleDisplay(tree *tr, uint64_t *a, char *name)
+{
+  /* Draws the tree, then redraws it whenever it is panned or zoomed,
+   * waiting for events in between rather than polling */
+  SDL_Simplewin sw;
+  fntrow fontdata[FNTCHARS][FNTHEIGHT];
+  unsigned long bytes = encodedBytes(tr, a);
+  treeLayout l;
+  view v;
+
+  layoutTree(tr, XOFFSET, YOFFSET, &l);
+  Neill_SDL_Init(&sw);
+  Neill_SDL_ReadFont(fontdata, FNTFILE);
+  v.x = v.y = 0;
+  v.zoom = 1.0;
+  zoomView(&v, 1.0);
+  redraw(tr, &l, &v, &sw, fontdata, name, bytes);
+
+  while (!sw.finished) {
+    if (handleEvents(&sw, &v)) {
+      clampView(&v, &l);
+      redraw(tr, &l, &v, &sw, fontdata, name, bytes);
+    }
+  }
+
+  freeLayout(&l);
+  SDL_Quit();
+}
+
+int handleEvents(SDL_Simplewin *sw, view *v)
+{
+  /* Waits for an event, then takes any others waiting too, and returns
+   * 1 if the view has changed */
+  SDL_Event e;
+  int changed = 0, more, moved;
+  int stepx = WWIDTH / PANSTEP / v->zoom;
+  int stepy = (WHEIGHT - TOPOFFSET) / PANSTEP / v->zoom;
+
+  for (more = SDL_WaitEvent(&e); more; more = SDL_PollEvent(&e)) {
+    moved = 1;
+    switch (e.type) {
+      case SDL_QUIT:
+        sw->finished = 1;
+        break;
+      case SDL_KEYDOWN:
+        switch (e.key.keysym.sym) {
+          case SDLK_q:
+          case SDLK_ESCAPE:
+            sw->finished = 1;
+            break;
+          case SDLK_LEFT:
+            v->x -= stepx;
+            break;
+          case SDLK_RIGHT:
+            v->x += stepx;
+            break;
+          case SDLK_UP:
+            v->y -= stepy;
+            break;
+          case SDLK_DOWN:
+            v->y += stepy;
+            break;
+          case SDLK_PLUS:
+          case SDLK_EQUALS:
+          case SDLK_KP_PLUS:
+            zoomView(v, v->zoom * ZOOMSTEP);
+            break;
+          case SDLK_MINUS:
+          case SDLK_KP_MINUS:
+            zoomView(v, v->zoom / ZOOMSTEP);
+            break;
+          case SDLK_HOME:
+            v->x = v->y = 0;
+            v->zoom = 1.0;
+            zoomView(v, 1.0);
+            break;
+          default:
+            moved = 0;
+        }
+        break;
+      case SDL_MOUSEMOTION:
+        if (e.motion.state & SDL_BUTTON_LMASK) {
+          v->x -= e.motion.xrel / v->zoom;
+          v->y -= e.motion.yrel / v->zoom;
+        }
+        else {
+          moved = 0;
+        }
+        break;
+      case SDL_MOUSEWHEEL:
+        zoomView(v, e.wheel.y > 0 ? v->zoom * ZOOMSTEP : v->zoom / ZOOMSTEP);
+        break;
+      case SDL_WINDOWEVENT:
+        /* uncovered or restored, so needs drawing again */
+        break;
+      default:
+        moved = 0;
+    }
+    changed |= moved;
+  }
+  return changed && !sw->finished;
+}
+
+void zoomView(view *v, double zoom)
+{
+  /* zooms to zoom, keeping the middle of the drawing area in place */
+  int w = WWIDTH, h = WHEIGHT - TOPOFFSET;
+
+  if (zoom < MINZOOM) {
+    zoom = MINZOOM;
+  }
+  if (zoom > MAXZOOM) {
+    zoom = MAXZOOM;
+  }
+  v->x += w / 2 / v->zoom - w / 2 / zoom;
+  v->y += h / 2 / v->zoom - h / 2 / zoom;
+  v->zoom = zoom;
+  v->top = TOPOFFSET / zoom;
+}
+
+void clampView(view *v, treeLayout *l)
+{
+  /* keeps at least half the drawing area on the tree */
+  int w = WWIDTH / v->zoom, h = (WHEIGHT - TOPOFFSET) / v->zoom;
+  int xmax = (l->xlen + 1) * FNTWIDTH - w / 2;
+  int ymax = l->ylen * FNTHEIGHT - h / 2;
+
+  v->x = max(min(v->x, xmax), -w / 2);
+  v->y = max(min(v->y, ymax), -h / 2);
+}
+
+void redraw(tree *tr, treeLayout *l, view *v, SDL_Simplewin *sw,
+  fntrow fontdata[FNTCHARS][FNTHEIGHT], char *name, unsigned long bytes)
+{
+  SDL_Rect panel;
+
+  Neill_SDL_SetDrawColour(sw, 0, 0, 0);
+  SDL_RenderClear(sw->renderer);
+  SDL_RenderSetScale(sw->renderer, v->zoom, v->zoom);
+  drawTree(tr, l, v, sw, fontdata);
+
+  /* the panel is drawn over the top of the tree, at full size */
+  SDL_RenderSetScale(sw->renderer, 1.0, 1.0);
+  panel.x = panel.y = 0;
+  panel.w = WWIDTH;
+  panel.h = TOPOFFSET;
+  Neill_SDL_SetDrawColour(sw, 0, 0, 0);
+  SDL_RenderFillRect(sw->renderer, &panel);
+  drawInfo(sw, fontdata, name, bytes, v->zoom);
+  SDL_RenderPresent(sw->renderer);
+}
+
+void drawTree(tree *tr, treeLayout *l, view *v, SDL_Simplewin *sw,
+  fntrow fontdata[FNTCHARS][FNTHEIGHT])
+{
+  /* draws only the nodes in view, from the cached layout */
+  int n, nnodes = 2 * tr->len - 1;
+
+  for (n = 0; n < nnodes; n++) {
+    if (isVisible(tr, l, v, n)) {
+      drawBranches(tr, l, v, n, sw);
+    }
+  }
+
+  /* This blend mode stops the nodes and branches being covered
+   * over by the text layer. */
+  SDL_SetRenderDrawBlendMode(sw->renderer, SDL_BLENDMODE_ADD);
+  for (n = 0; n < nnodes; n++) {
+    if (tr->a[n].left == NOCHILD && isVisible(tr, l, v, n)) {
+      drawLeaf(l->x[n], l->y[n], tr->a[n].c, v, sw, fontdata);
+    }
+  }
+  SDL_SetRenderDrawBlendMode(sw->renderer, SDL_BLENDMODE_NONE);
+}
+
+int isVisible(tree *tr, treeLayout *l, view *v, int n)
+{
+  /* whether any of n, or the branches to its children, is in view */
+  int right = tr->a[n].right;
+  int x0 = l->x[n] * FNTWIDTH, y0 = l->y[n] * FNTHEIGHT;
+  int x1 = ((right != NOCHILD ? l->x[right] : l->x[n]) + 2) * FNTWIDTH;
+  int y1 = (l->y[n] + (tr->a[n].left != NOCHILD ? YOFFSET : 1)) * FNTHEIGHT;
+
+  return x1 + NRADIUS >= v->x
+    && x0 - NRADIUS <= v->x + WWIDTH / v->zoom
+    && y1 + NRADIUS >= v->y
+    && y0 - NRADIUS <= v->y + (WHEIGHT - TOPOFFSET) / v->zoom;
+}
+
+void drawInfo(SDL_Simplewin *sw, fntrow fontdata[FNTCHARS][FNTHEIGHT],
+  char *name, unsigned long bytes, double zoom)
+{
+  char s[WWIDTH / FNTWIDTH] = "";
+
+  sprintf(s, "Huffman tree %d%%", (int)(zoom * 100 + 0.5));
+  Neill_SDL_DrawString(sw, fontdata, s, 0, 0);
+  strncpy(s, name, WWIDTH / FNTWIDTH - 1);
+  /* doesn't bother loading any more than can fit on the screen */
+  Neill_SDL_DrawString(sw, fontdata, s, 0, FNTHEIGHT);
+  sprintf(s, "%lu Bytes", bytes);
+  Neill_SDL_DrawString(sw, fontdata, s, 0, FNTHEIGHT * 2);
+}
+
+unsigned long encodedBytes(tree *tr, uint64_t *a)
+{
+  uint64_t bits;
+  codeTable t;
+
+  buildCodeTable(tr, &t);
+  bits = codedBits(a, &t);
+  return bits / BITSPERBYTE + (bits % BITSPERBYTE != 0); /* rounds up */
+}
+
+void drawBranches(tree *tr, treeLayout *l, view *v, int n, SDL_Simplewin *sw)
+{
+  int nodeheight = min(l->height[n] + 1,UINT8_MAX);
+  colour nodeclr = {0 , NODEGREEN, NODEBLUE };
+  
+  nodeclr.red = UINT8_MAX - UINT8_MAX / nodeheight;
+  Neill_SDL_SetDrawColour(sw, nodeclr.red, 
+    nodeclr.blue, nodeclr.green);
+  drawNode(l->x[n], l->y[n], v, sw);
+  
+  if (tr->a[n].left != NOCHILD) {
+    nodeclr.red = UINT8_MAX - UINT8_MAX / (nodeheight - 1);
+    Neill_SDL_SetDrawColour(sw, nodeclr.red, 
+      nodeclr.blue, nodeclr.green);    
+    drawLeftBranch(l->x[n], l->y[n], v, sw);
+  }
+
+  if (tr->a[n].right != NOCHILD) {
+    nodeclr.red = UINT8_MAX - UINT8_MAX / (nodeheight - 1);
+    Neill_SDL_SetDrawColour(sw, nodeclr.red, 
+      nodeclr.blue, nodeclr.green);   
+    drawRightBranch(l->x[n], l->y[n], l->x[tr->a[n].right], v, sw);
+  }
+
+}
+
+void drawLeftBranch(int x, int y, view *v, SDL_Simplewin *sw)
+{
+  int SDLx = (x + 1) * FNTWIDTH + FNTWIDTH / 2 - v->x;
+  int SDLy = (y + 1) * FNTHEIGHT  + PADDING + v->top - v->y;
+  int SDLdy = YOFFSET * FNTHEIGHT - FNTHEIGHT - PADDING * 2;
+  
+  if (SDL_RenderDrawLine(sw->renderer, 
+    SDLx, SDLy, SDLx, SDLy + SDLdy ) != 0) {
+      fprintf(stderr, "\nFailed to draw line:  %s\n", SDL_GetError());
+      SDL_Quit();
+      exit(1);
+    }
+}
+
+void drawRightBranch(int x, int y, int xr, view *v, SDL_Simplewin *sw)
+{
+  /* from the node at x to its right child at xr, on the same row */
+  int SDLx = (x + 2)* FNTWIDTH + PADDING - v->x;
+  int SDLy = y * FNTHEIGHT + FNTHEIGHT / 2 + v->top - v->y;   
+  int SDLdx = (xr - x - 1) * FNTWIDTH - PADDING * 2;
+  
+  if (SDL_RenderDrawLine(sw->renderer, 
+    SDLx, SDLy, SDLx + SDLdx, SDLy) != 0) {
+      fprintf(stderr, "\nFailed to draw line:  %s\n", SDL_GetError());
+      SDL_Quit();
+      exit(1);
+    } 
+}
+
+void drawNode(int x, int y, view *v, SDL_Simplewin *sw)
+{
+  int SDLx = (x + 1) * FNTWIDTH + FNTWIDTH / 2 - v->x;
+  int SDLy = y * FNTHEIGHT + FNTHEIGHT / 2  + v->top - v->y;
+  
+  Neill_SDL_RenderFillCircle(sw->renderer, SDLx, SDLy, NRADIUS);
+}
+
+void drawLeaf(int x, int y, int c, view *v, SDL_Simplewin *sw,
+  fntrow fontdata[FNTCHARS][FNTHEIGHT])
+{
+  if (!isprint(c) || c < FNT1STCHAR || c >= FNT1STCHAR + FNTCHARS) {
+    c = UNPRINTABLE;
+  }
+  Neill_SDL_DrawChar(sw, fontdata, c, (x + 1) * FNTWIDTH - v->x,
+    y * FNTHEIGHT + v->top - v->y);
+}
+
+int min(int a, int b)
+{
+  if (a > b) {
+    return b;
+  }
+  else {
+    return a;
+  }
+}
+
+int max(int a, int b)
+{
+  if (a < b) {
+    return b;
+  }
+  else {
+    return a;
+  }
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+/* huffseek.c
+ *
+ * Part of libhuff (see huff.h): seek tables, for reading a range of a
+ * compressed file without decoding all of the blocks it falls in.
+ *
+ * The index already finds the block holding any offset, but a block is
+ * up to MAXBLOCKSIZE bytes, and reading a few bytes from the end of one
+ * would mean decoding all of it.  So a file compressed with a seek
+ * interval also has a BLOCKSEEK block, just before the end block, with
+ * an entry for every interval bytes into each block: the bit offset of
+ * that char's code in the block's bitstream, and the char before it,
+ * which BLOCKCTX blocks need to pick its table.  Decoding can then start
+ * at the last entry before the range, and stop at the end of it.
+ *
+ * The BLOCKSEEK block has the interval in place of its raw length, and
+ * the end block has the seek block's length in place of its own raw
+ * length, which was always 0, so files without one read as before.  The
+ * interval is even, so every entry in a BLOCKPAIR block starts a pair.
+ * BLOCKHUFF4 blocks have no entries to use, as their streams can't be
+ * started partway, and are decoded whole.  BLOCKRAW blocks have entries
+ * like any other, but don't need them to be read from anywhere.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+#define SEEKBITSLEN 5 /* bytes of the bit offset in each seek entry */
+
+size_t seekEntries(size_t n, size_t every)
+{
+  /* the number of seek entries in a block of n bytes, one for each
+   * multiple of every after the first char */
+  return n > 0 ? (n - 1) / every : 0;
+}
+
+void seekPoints(const unsigned char *blk, size_t blklen,
+  const unsigned char *p, size_t n, size_t every, unsigned char *out)
+{
+  /* Writes the seek entries of the n bytes at p, coded as the block of
+   * blklen bytes at blk, to out, which has room for seekEntries(n, every)
+   * of them.  The bit offsets come from adding up the code lengths found
+   * in the block. */
+  unsigned char map[ASIZE], *lens = NULL;
+  codeTable t[CTXTABLES];
+  uint64_t bits = 0;
+  size_t i;
+  int k = 0, prev = 0;
+
+  if (blk[0] == BLOCKHUFF4) {
+    huffError("interleaved blocks can't have seek tables");
+    fail();
+  }
+  if (blk[0] == BLOCKPAIR) {
+    lens = (unsigned char *)allocMem(PAIRSYMS);
+    readPairTable(blk, blklen, n, lens);
+  }
+  else if (blk[0] == BLOCKCTX) {
+    readContextTables(blk, blklen, map, t, &k);
+  }
+  else if (blk[0] == BLOCKRAW) {
+    for (i = 0; i < ASIZE; i++) {
+      t[0].len[i] = BITSPERBYTE;
+    }
+    memset(map, 0, ASIZE);
+  }
+  else {
+    readLengths(blk + BLOCKHDRLEN, &t[0]);
+    memset(map, 0, ASIZE);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (i > 0 && i % every == 0) {
+      writeUint(out, bits, SEEKBITSLEN);
+      out[SEEKBITSLEN] = p[i - 1];
+      out += SEEKENTRY;
+    }
+    if (lens == NULL) {
+      bits += t[map[prev]].len[p[i]];
+    }
+    else if (i % 2 == 0 && i + 1 < n) {
+      bits += lens[p[i] << BITSPERBYTE | p[i + 1]];
+    }
+    prev = p[i];
+  }
+  freeMem(lens);
+}
+
+void writeSeekTable(FILE *out, const unsigned char *p, size_t n,
+  size_t every)
+{
+  /* writes the n bytes of seek entries at p as a BLOCKSEEK block */
+  unsigned char hdr[BLOCKHDRLEN];
+
+  hdr[0] = BLOCKSEEK;
+  writeUint(hdr + 1, every, 4);
+  writeUint(hdr + 5, n, 4);
+  if (fwrite(hdr, 1, BLOCKHDRLEN, out) != BLOCKHDRLEN
+    || fwrite(p, 1, n, out) != n) {
+    huffError("failed to write output");
+    fail();
+  }
+}
+
+const unsigned char *readSeekTable(inputFile *f, int nblocks, uint64_t *coff,
+  uint64_t *roff, size_t *every)
+{
+  /* Returns the seek entries of the file f, with nblocks blocks at coff
+   * and roff in its index, and sets *every to their interval, or returns
+   * NULL if it has none.  There must be an entry for every interval in
+   * each block. */
+  const unsigned char *p = f->data + coff[nblocks];
+  uint64_t n = 0;
+  int i;
+
+  if (p[0] == BLOCKEND) {
+    return NULL;
+  }
+  *every = readUint(p + 1, 4);
+  if (p[0] != BLOCKSEEK || *every == 0 || *every % 2 != 0
+    || readUint(p + 5, 4) + BLOCKHDRLEN > f->len - coff[nblocks]) {
+    huffError("corrupt seek table");
+    fail();
+  }
+  for (i = 0; i < nblocks; i++) {
+    n += seekEntries(roff[i + 1] - roff[i], *every);
+  }
+  if (readUint(p + 5, 4) != n * SEEKENTRY) {
+    huffError("corrupt seek table");
+    fail();
+  }
+  return p + BLOCKHDRLEN;
+}
+
+size_t decodeSpan(const unsigned char *p, size_t n, size_t len,
+  const unsigned char *seek, size_t every, size_t from, size_t to,
+  unsigned char *out)
+{
+  /* Decodes the chars of the n byte block at p, which holds len, from
+   * the last seek entry in seek at or before from, up to to, into out,
+   * and returns the offset of the first.  With no seek entries, or in a
+   * BLOCKHUFF4 block, the chars before to are all decoded, and a
+   * BLOCKRAW block is just copied from from. */
+  decodeTable *dt;
+  codeTable t;
+  uint64_t bitoff = 0;
+  size_t at = 0, k;
+  bitReader r;
+  int prev = 0;
+
+  if (n < BLOCKHDRLEN
+    || p[0] > BLOCKRAW
+    || (p[0] != BLOCKPAIR && p[0] != BLOCKRAW
+    && n < BLOCKHDRLEN + LENGTHSLEN)
+    || readUint(p + 5, 4) != n - BLOCKHDRLEN
+    || readUint(p + 1, 4) != len
+    || (p[0] == BLOCKRAW && len != n - BLOCKHDRLEN)) {
+    huffError("corrupt block header");
+    fail();
+  }
+  if (p[0] == BLOCKRAW) {
+    memcpy(out, p + BLOCKHDRLEN + from, to - from);
+    return from;
+  }
+  if (p[0] == BLOCKHUFF4) {
+    decodeBlock(p, n, out, len);
+    return 0;
+  }
+  /* the entry at or before from, though from can be len, which has none
+   * of its own */
+  k = seek == NULL ? 0 : from / every < seekEntries(len, every)
+    ? from / every : seekEntries(len, every);
+  if (k > 0) {
+    at = k * every;
+    seek += (k - 1) * SEEKENTRY;
+    bitoff = readUint(seek, SEEKBITSLEN);
+    prev = seek[SEEKBITSLEN];
+  }
+
+  if (p[0] == BLOCKPAIR) {
+    decodePairs(p, n, len, at, bitoff, out, to - at);
+  }
+  else if (p[0] == BLOCKCTX) {
+    decodeContexts(p, n, bitoff, prev, out, to - at);
+  }
+  else {
+    readLengths(p + BLOCKHDRLEN, &t);
+    assignCanonicalCodes(&t);
+    dt = (decodeTable *)allocMem(sizeof(decodeTable));
+    buildDecodeTable(&t, dt);
+    seekReader(&r, p + BLOCKHDRLEN + LENGTHSLEN, n - BLOCKHDRLEN - LENGTHSLEN,
+      bitoff);
+    decodeFrom(&r, dt, out, to - at);
+    freeMem(dt);
+  }
+  return at;
+}
+
+void decompressRange(char *inname, char *outname, uint64_t start,
+  uint64_t len)
+{
+  /* Writes the len bytes from start of the decompressed file, or as
+   * many of them as there are.  Only the blocks holding the range are
+   * decoded, and with a seek table only the part of each that is
+   * needed. */
+  const unsigned char *seek;
+  unsigned char *buf;
+  uint64_t *coff, *roff, end;
+  inputFile in;
+  FILE *out;
+  size_t blocksize, every = 0, from, at;
+  int nblocks, lo, hi, b;
+
+  openInput(inname, &in);
+  if (in.len >= ADAPTHDRLEN && memcmp(in.data, MAGIC, MAGICLEN) == 0
+    && (in.data[MAGICLEN] == ADAPTVERSION
+    || in.data[MAGICLEN] == TABLEDVERSION)) {
+    huffError("%s has no blocks to read a range from",
+      inname);
+    fail();
+  }
+  blocksize = readHeader(in.data, in.len);
+  nblocks = readIndex(&in, blocksize, &coff, &roff);
+  seek = readSeekTable(&in, nblocks, coff, roff, &every);
+  if (start > roff[nblocks]) {
+    start = roff[nblocks];
+  }
+  end = len < roff[nblocks] - start ? start + len : roff[nblocks];
+  buf = (unsigned char *)allocMem(roff[nblocks] < blocksize
+    ? roff[nblocks] + 1 : blocksize);
+
+  /* the last block starting at or before start */
+  lo = 0;
+  hi = nblocks;
+  while (hi - lo > 1) {
+    b = lo + (hi - lo) / 2;
+    if (roff[b] <= start) {
+      lo = b;
+    }
+    else {
+      hi = b;
+    }
+  }
+  for (b = 0; b < lo && seek != NULL; b++) {
+    seek += seekEntries(roff[b + 1] - roff[b], every) * SEEKENTRY;
+  }
+
+  /* an empty range, even one at the end of the file, decodes nothing */
+  out = openFile(outname, "wb");
+  for (b = lo; b < nblocks && roff[b] < end && start < end; b++) {
+    from = start > roff[b] ? start - roff[b] : 0;
+    at = decodeSpan(in.data + coff[b], coff[b + 1] - coff[b],
+      roff[b + 1] - roff[b], seek, every, from,
+      (end < roff[b + 1] ? end : roff[b + 1]) - roff[b], buf);
+    len = (end < roff[b + 1] ? end : roff[b + 1]) - roff[b] - from;
+    if (fwrite(buf + (from - at), 1, len, out) != len) {
+      huffError("failed to write output");
+      fail();
+    }
+    if (seek != NULL) {
+      seek += seekEntries(roff[b + 1] - roff[b], every) * SEEKENTRY;
+    }
+  }
+
+  closeInput(&in);
+  freeMem(buf);
+  freeMem(coff);
+  freeMem(roff);
+  closeFile(out, outname);
+}
@@ -0,0 +1,182 @@
+/* hufftable.c
+ *
+ * Part of libhuff (see huff.h): code tables trained once, from the
+ * counts of a set of samples, and shared by many small inputs.
+ *
+ * A table file is the magic, the TABLEVERSION byte and a code length
+ * nibble for each of the 256 byte values, in LENGTHSLEN = 128 bytes as
+ * in a block.  Every byte value gets a code, even those missing from
+ * the samples, so any input can be coded with it.  An input coded with
+ * a table has no code lengths or blocks, just the magic, the
+ * TABLEDVERSION byte, its length and the bitstream, and needs the same
+ * table to decode it.
+ *
+ * loadTable() builds the decode table along with the codes, so loaded
+ * once it can be shared, read-only, by any number of threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "huff.h"
+
+#define MAXTABLEDLEN 0xFFFFFFFFUL /* raw length must fit in 4 bytes */
+
+void trainTable(char **names, int n, int maxcodelen, int threads,
+  codeTable *t)
+{
+  /* canonical codes for the counts of all n files together, with one
+   * more of every byte value so that none is left without a code */
+  uint64_t freqs[ASIZE] = {0};
+  int i;
+
+  for (i = 0; i < n; i++) {
+    getFreqsFromFile(names[i], freqs, threads);
+  }
+  for (i = 0; i < ASIZE; i++) {
+    freqs[i]++;
+  }
+  buildCodes(freqs, maxcodelen, t);
+}
+
+void writeTable(char *name, codeTable *t)
+{
+  unsigned char p[TABLELEN];
+  FILE *out = openFile(name, "wb");
+
+  memcpy(p, MAGIC, MAGICLEN);
+  p[MAGICLEN] = TABLEVERSION;
+  writeLengths(p + MAGICLEN + 1, t);
+  if (fwrite(p, 1, TABLELEN, out) != TABLELEN) {
+    huffError("failed to write %s", name);
+    fail();
+  }
+  closeFile(out, name);
+}
+
+void loadTable(char *name, huffTable *ht)
+{
+  inputFile f;
+  int i;
+
+  openInput(name, &f);
+  if (f.len != TABLELEN || memcmp(f.data, MAGIC, MAGICLEN) != 0
+    || f.data[MAGICLEN] != TABLEVERSION) {
+    huffError("%s is not a code table", name);
+    fail();
+  }
+  readLengths(f.data + MAGICLEN + 1, &ht->t);
+  closeInput(&f);
+  for (i = 0; i < ASIZE; i++) {
+    if (ht->t.len[i] == 0) {
+      huffError("%s has no code for byte %d", name, i);
+      fail();
+    }
+  }
+  assignCanonicalCodes(&ht->t);
+  buildDecodeTable(&ht->t, &ht->dt);
+}
+
+size_t tableBytes(size_t n)
+{
+  /* the most n bytes can take up, coded with a table */
+  return TABLEDHDRLEN + (n * MAXCODELEN + BITSPERBYTE - 1) / BITSPERBYTE;
+}
+
+size_t huff_table_encode(huffTable *ht, const unsigned char *p, size_t n,
+  unsigned char *out)
+{
+  /* Codes the n bytes at p into out, which must have room for
+   * tableBytes(n), and returns the number of bytes written. */
+  if (n > MAXTABLEDLEN) {
+    huffError("input too large for a table - compress it"
+      " in blocks");
+    fail();
+  }
+  memcpy(out, MAGIC, MAGICLEN);
+  out[MAGICLEN] = TABLEDVERSION;
+  writeUint(out + MAGICLEN + 1, n, 4);
+  return TABLEDHDRLEN + encodeBytes(p, n, out + TABLEDHDRLEN, &ht->t);
+}
+
+size_t huff_table_decode(huffTable *ht, const unsigned char *p, size_t n,
+  unsigned char *out, size_t maxlen)
+{
+  /* Decodes the n bytes at p into out, and returns the decoded length,
+   * which is at most maxlen. */
+  size_t len;
+
+  if (n < TABLEDHDRLEN || memcmp(p, MAGIC, MAGICLEN) != 0
+    || p[MAGICLEN] != TABLEDVERSION) {
+    huffError("not coded with a table");
+    fail();
+  }
+  len = readUint(p + MAGICLEN + 1, 4);
+  if (len > maxlen) {
+    huffError("output too small for the decoded data");
+    fail();
+  }
+  decodeWithTable(p + TABLEDHDRLEN, n - TABLEDHDRLEN, out, len, &ht->dt);
+  return len;
+}
+
+size_t tabledLength(const unsigned char *p, size_t n)
+{
+  /* the decoded length of the n bytes coded with a table at p, which
+   * can't be more than one char for every bit */
+  size_t len;
+
+  if (n < TABLEDHDRLEN) {
+    huffError("compressed data is truncated");
+    fail();
+  }
+  len = readUint(p + MAGICLEN + 1, 4);
+  if (len / BITSPERBYTE > n - TABLEDHDRLEN) {
+    huffError("corrupt file header");
+    fail();
+  }
+  return len;
+}
+
+void compressTableFile(char *inname, char *outname, huffTable *ht)
+{
+  inputFile in;
+  unsigned char *buf;
+  size_t len;
+
+  openInput(inname, &in);
+  if (in.len > MAXTABLEDLEN) {
+    huffError("input too large for a table - compress it"
+      " in blocks");
+    fail();
+  }
+  buf = (unsigned char *)allocMem(tableBytes(in.len));
+  len = huff_table_encode(ht, in.data, in.len, buf);
+  closeInput(&in);
+  writeOutput(outname, buf, len);
+  freeMem(buf);
+}
+
+void decompressTableFile(inputFile *in, char *outname, huffTable *ht)
+{
+  /* decodes the mapped file in, coded with ht, and closes it */
+  size_t len = tabledLength(in->data, in->len);
+  unsigned char *buf = (unsigned char *)allocMem(len);
+
+  huff_table_decode(ht, in->data, in->len, buf, len);
+  closeInput(in);
+  writeOutput(outname, buf, len);
+  freeMem(buf);
+}
+
+void writeOutput(char *name, const unsigned char *p, size_t n)
+{
+  FILE *out = openFile(name, "wb");
+
+  if (fwrite(p, 1, n, out) != n) {
+    huffError("failed to write %s", name);
+    fail();
+  }
+  closeFile(out, name);
+}
@@ -1,12 +1,17 @@
 /* hufftest.c
  * 
  * Function: tests different approaches to building a huffman binary tree.
- * The approaches are: qsorted array, insertion sorted array, and 
- * binary search + memmove (the approach I use in the actual implementation).
- * Usage: filename
+ * The approaches are: qsorted array, insertion sorted array, 
+ * binary search + memmove, and two queues (the approach now used in the
+ * actual implementation).
+ * Usage: filename [seed]
+ * Run with the other benchmarks by 'make bench'.
  * 
  * creates an array of ASIZE nodes with frequency rand() % RMOD, and then 
  * times how long each different approach takes to sort the same values.
+ * The seed is fixed unless given, so every run builds the same trees.
+ * Each approach is run once to warm up and then timed REPEATS times, and
+ * the median is printed, in the same tab-separated format as huffbench.
  * Unfortunately I haven't had time to implement a linked-list insertion
  * sort, which would probably do quite well - but I don't think it would
  * be better than mine, since insertion sort cannot match the binary 
@@ -14,6 +19,8 @@
  * has been implemented in the system used.
  */
 
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -23,6 +30,8 @@
 #define ASIZE 5000
 #define PNODE -250 /* char field of the parent nodes */
 #define RMOD 10000
+#define SEED 1
+#define REPEATS 7 /* timed runs of each approach */
 
 typedef struct node {
   int freq;
@@ -46,6 +55,9 @@ node **createNodeIndex(int *a, int len);
 int  calcNodeCnt(int *a);
 void freeNodes(node *n);
 void fillTestArray(int *a);
+void timeTest(char *name, void (*test)(int *testarray), int *testarray);
+double getSeconds(void);
+int  doubleComp(const void *a, const void *b);
 
 void testBinary(int *testarray);
 int  getInsertionPoint(int key, nodeIndex *index, int start);
@@ -59,39 +71,62 @@ void testQsort(int *testarray);
 node *populateTreeQSORT(nodeIndex *index);
 int  nodeComp(const void * a, const void * b);
 
-int main(void)
+void testTwoQueue(int *testarray);
+node *populateTreeQUEUE(nodeIndex *index);
+node *takeSmallest(nodeIndex *index, int *leaf, node **parents, int *head,
+  int tail);
+
+int main(int argc, char **argv)
 {
   int testarray[ASIZE] = {0};
-  clock_t begin, end;
-  double timespent;
-  
-  srand(time(NULL));
+
+  srand(argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : SEED);
   fillTestArray(testarray);   
-  
-  printf("test array filled with %d random frequencies.\n", ASIZE);
-  printf("with values from 0 - %d.\n\n", RMOD); 
-    
-  begin = clock();
-  testQsort(testarray);
-  end = clock();
-  timespent = (double)(end - begin) / CLOCKS_PER_SEC;
-  printf("time spent to execute qsort: %fs\n", timespent);
-  
-  begin = clock();
-  testBinary(testarray);
-  end = clock();
-  timespent = (double)(end - begin) / CLOCKS_PER_SEC;
-  printf("time spent to execute binary search + memmove: %fs\n", timespent);
-  
-  begin = clock();
-  testInsertion(testarray);
-  end = clock();
-  timespent = (double)(end - begin) / CLOCKS_PER_SEC;
-  printf("time spent to execute insertion sort: %fs\n", timespent);
+
+  printf("# input\tstage\tsymbols\tmedian_ns\tns_per_symbol"
+    "\tMB_per_s\tratio\n");
+  timeTest("qsort", testQsort, testarray);
+  timeTest("binary", testBinary, testarray);
+  timeTest("insertion", testInsertion, testarray);
+  timeTest("twoqueue", testTwoQueue, testarray);
 
   return 0;
 }
 
+void timeTest(char *name, void (*test)(int *testarray), int *testarray)
+{
+  /* MB/s and ratio only apply to real input, so are left as - */
+  double sample[REPEATS], start;
+  int r;
+
+  test(testarray);
+  for (r = 0; r < REPEATS; r++) {
+    start = getSeconds();
+    test(testarray);
+    sample[r] = getSeconds() - start;
+  }
+  qsort(sample, REPEATS, sizeof(double), doubleComp);
+  printf("random%d\t%s\t%d\t%.0f\t%.1f\t-\t-\n", ASIZE, name, ASIZE,
+    sample[REPEATS / 2] * 1e9, sample[REPEATS / 2] * 1e9 / ASIZE);
+  fflush(stdout);
+}
+
+double getSeconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int doubleComp(const void *a, const void *b)
+{
+  double d1 = *(const double *)a;
+  double d2 = *(const double *)b;
+
+  return (d1 > d2) - (d1 < d2);
+}
+
 void testInsertion(int *testarray)
 {
 
@@ -135,6 +170,20 @@ void testQsort(int *testarray)
   freeNodes(root);
 }
 
+void testTwoQueue(int *testarray)
+{
+  nodeIndex index = {NULL, 0};
+  node *root;
+
+  index.len = calcNodeCnt(testarray);
+  index.a = createNodeIndex(testarray, index.len);
+  qsort(index.a, index.len, sizeof(node *), nodeComp);
+  root = populateTreeQUEUE(&index);
+
+  free(index.a);
+  freeNodes(root);
+}
+
 node *populateTreeQSORT(nodeIndex *index)
 {
   int newfreq, start = 0, len = index->len;
@@ -179,10 +228,11 @@ void insertionSort(nodeIndex *index, int start)
     if (index->a[i] == NULL) {
       printf("ohno\n");
     }
-    while (j > 0 && index->a[j-1]->freq > index->a[j]->freq) {
+    while (j > start && index->a[j-1]->freq > index->a[j]->freq) {
       temp = index->a[j-1];
       index->a[j-1] = index->a[j];
       index->a[j] = temp;
+      j--;
     }
   }
 }
@@ -207,6 +257,40 @@ node *populateTreeBINARY(nodeIndex *index)
   return index->a[index->len - 1]; /* return pointer to root node */
 }
 
+node *populateTreeQUEUE(nodeIndex *index)
+{
+  /* leaves stay in index->a, parents go to the back of a second queue,
+   * which is sorted because each parent is at least as big as the last */
+  int newfreq, leaf = 0, head = 0, tail;
+  node *lchild, *rchild, *root;
+  node **parents = (node **)calloc(index->len - 1, sizeof(node *));
+
+  if (parents == NULL) {
+    fprintf(stderr,"ERROR: parent queue alloc failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (tail = 0; tail < index->len - 1; tail++) {
+    lchild = takeSmallest(index, &leaf, parents, &head, tail);
+    rchild = takeSmallest(index, &leaf, parents, &head, tail);
+    newfreq = lchild->freq + rchild->freq;
+    parents[tail] = createNode(PNODE, newfreq, lchild, rchild);
+  }
+  root = parents[tail - 1];
+  free(parents);
+  return root;
+}
+
+node *takeSmallest(nodeIndex *index, int *leaf, node **parents, int *head,
+  int tail)
+{
+  if (*head == tail || (*leaf < index->len 
+    && index->a[*leaf]->freq <= parents[*head]->freq)) {
+    return index->a[(*leaf)++];
+  }
+  return parents[(*head)++];
+}
+
 int getInsertionPoint(int key, nodeIndex *index, int start)
 {
   int end = index->len - 1, mid;
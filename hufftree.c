@@ -0,0 +1,492 @@
+/* hufftree.c
+ * 
+ * Part of libhuff (see huff.h): counts the bytes of the input, builds
+ * the huffman tree, and turns it into a table of codes.
+ *
+ * The whole tree lives in one runtime-sized array of node structures,
+ * where children are referred to by their position in the array.  It
+ * starts with a leaf for each char in the input, tracking its frequency.
+ * These are qsorted once, and then the tree is built with two queues:
+ * the sorted leaves, and the parents in the order they are made, which
+ * is also sorted, and are stored after the leaves.  The 2 smallest nodes
+ * are always at the front of one or the other, so no searching or moving
+ * of elements is needed, and the tree is freed with a single freeMem().
+ * Once the tree is complete, a single recursive traversal fills a table
+ * with the huffman encoding of every char, packed into an integer, and
+ * both printing and encoding read from that table.
+ *
+ * Compression only keeps the code length of each char from the tree, and
+ * assigns canonical codes: chars are ordered by code length, then by
+ * value, and given consecutive codes.  So the decoder can rebuild the
+ * codes from the lengths alone, whatever tie-breaking built the tree.
+ * Lengths are capped at MAXCODELEN so they fit in a nibble, or optimal
+ * codes of a chosen maximum length are found directly by package-merge.
+ *
+ * For a quick estimate on a huge input, only every Nth SAMPLECHUNK of
+ * it need be counted.  Only those pages of the mapping are ever read,
+ * and the counts are scaled up to the whole input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "huff.h"
+
+#define PNODE -250 /* arbitrary non-byte char field for the 
+ * parent nodes */
+#define NHISTS 4 /* interleaved histograms used when counting */
+#define COUNTCHUNK (1UL << 30) /* most bytes counted in 32-bit counters */
+#define MINTHREADBYTES (1 << 20) /* smallest range worth a thread */
+
+uint64_t *getFreqsFromFile(char *filename, uint64_t *a, int threads)
+{
+  /* the file is mapped, so every byte is counted as it is, straight
+   * from the page cache */
+  inputFile f;
+
+  openInput(filename, &f);
+  countBytesParallel(f.data, f.len, a, threads);
+  closeInput(&f);
+  return a;
+}
+
+void sampleFreqs(const unsigned char *p, size_t n, int every, uint64_t *a)
+{
+  /* Counts every every-th SAMPLECHUNK bytes of p, starting with the
+   * first, and scales the counts by the share of p counted.  A char
+   * that was seen keeps a count of at least 1. */
+  size_t i, counted = 0;
+  uint64_t scaled;
+  int c;
+
+  for (i = 0; i < n; i += (size_t)every * SAMPLECHUNK) {
+    countBytes(p + i, n - i < SAMPLECHUNK ? n - i : SAMPLECHUNK, a);
+    counted += n - i < SAMPLECHUNK ? n - i : SAMPLECHUNK;
+  }
+  for (c = 0; c < ASIZE && counted < n; c++) {
+    if (a[c] != 0) {
+      scaled = (uint64_t)((double)a[c] * n / counted + 0.5);
+      a[c] = scaled != 0 ? scaled : 1;
+    }
+  }
+}
+
+void countBytes(const unsigned char *p, size_t n, uint64_t *a)
+{
+  /* Counting into a single table stalls on runs of the same byte, as
+   * each increment has to wait for the one before.  So 8 bytes are
+   * loaded at once and spread over NHISTS tables, which are added
+   * together at the end.  The tables hold 32-bit counts to halve their
+   * cache footprint, so at most COUNTCHUNK bytes go in before a merge. */
+  uint32_t h[NHISTS][ASIZE];
+  uint64_t w;
+  size_t i, len;
+  int j;
+
+  for (; n > 0; n -= len, p += len) {
+    len = n < COUNTCHUNK ? n : COUNTCHUNK;
+    memset(h, 0, sizeof(h));
+    for (i = 0; i + 8 <= len; i += 8) {
+      memcpy(&w, p + i, 8); /* byte order doesn't matter for counting */
+      h[0][w & 0xFF]++;
+      h[1][(w >> 8) & 0xFF]++;
+      h[2][(w >> 16) & 0xFF]++;
+      h[3][(w >> 24) & 0xFF]++;
+      h[0][(w >> 32) & 0xFF]++;
+      h[1][(w >> 40) & 0xFF]++;
+      h[2][(w >> 48) & 0xFF]++;
+      h[3][w >> 56]++;
+    }
+    for (; i < len; i++) {
+      h[0][p[i]]++;
+    }
+    for (j = 0; j < ASIZE; j++) {
+      a[j] += (uint64_t)h[0][j] + h[1][j] + h[2][j] + h[3][j];
+    }
+  }
+}
+
+void countBytesParallel(const unsigned char *p, size_t n, uint64_t *a,
+  int threads)
+{
+  /* Splits the input into a byte range per thread, each counted into
+   * its own table, and adds the tables together once all are done.
+   * The first range is counted on this thread.  A thread that can't be
+   * started just has its range counted here instead. */
+  countJob *jobs;
+  pthread_t tid[MAXTHREADS];
+  int started[MAXTHREADS] = {0};
+  size_t chunk;
+  int i, j;
+
+  if (threads > 1 && n / threads < MINTHREADBYTES) {
+    threads = n / MINTHREADBYTES;
+  }
+  if (threads <= 1) {
+    countBytes(p, n, a);
+    return;
+  }
+
+  jobs = (countJob *)allocMem(sizeof(countJob) * threads);
+  chunk = n / threads;
+  for (i = 0; i < threads; i++) {
+    jobs[i].p = p + i * chunk;
+    jobs[i].n = i == threads - 1 ? n - i * chunk : chunk;
+  }
+  for (i = 1; i < threads; i++) {
+    started[i] = pthread_create(&tid[i], NULL, countWorker, &jobs[i]) == 0;
+  }
+  countWorker(&jobs[0]);
+
+  for (i = 0; i < threads; i++) {
+    if (i > 0 && started[i]) {
+      pthread_join(tid[i], NULL);
+    }
+    else if (i > 0) {
+      countWorker(&jobs[i]);
+    }
+    for (j = 0; j < ASIZE; j++) {
+      a[j] += jobs[i].freqs[j];
+    }
+  }
+  freeMem(jobs);
+}
+
+void *countWorker(void *arg)
+{
+  countJob *job = (countJob *)arg;
+
+  memset(job->freqs, 0, sizeof(job->freqs));
+  countBytes(job->p, job->n, job->freqs);
+  return NULL;
+}
+
+void padFreqs(uint64_t *a)
+{
+  /* A tree needs at least 2 leaves, so an empty or single-char file is
+   * given dummy chars of frequency 1.  They are never written, since
+   * the decoder stops after the stored length. */
+  int i, cnt = 0;
+
+  for (i = 0; i < ASIZE; i++) {
+    if (a[i] != 0) {
+      cnt++;
+    }
+  }
+  for (i = 0; i < ASIZE && cnt < 2; i++) {
+    if (a[i] == 0) {
+      a[i] = 1;
+      cnt++;
+    }
+  }
+}
+
+void buildTree(uint64_t *a, tree *tr)
+{
+  tr->len = calcNodeCnt(a);
+  tr->a = createNodeArray(a, tr->len);
+  qsort(tr->a, tr->len, sizeof(node), nodeComp);
+  tr->root = populateTree(tr);
+}
+
+int calcNodeCnt(uint64_t *a)
+{
+  int i, cnt = 0;
+
+  for (i = 0; i < ASIZE; i++) {
+    if (a[i] != 0) {
+      cnt++;
+    }
+  }
+  
+  if (cnt < 2) {
+    huffError("too few nodes to build tree");
+    fail(); 
+  }
+  
+  return cnt;
+}
+
+void setNode(node *p, int c, uint64_t freq, int left, int right)
+{
+  p->freq = freq;
+  p->c = c;
+  p->left = left;
+  p->right = right;
+}
+
+node *createNodeArray(uint64_t *a, int len)
+{
+  /* One allocation holds the whole tree.  The leaves go at the start,
+   * and populateTree() adds the len - 1 parents after them. */
+  int i, j;
+  node *na = (node *)allocMem(sizeof(node) * (2 * len - 1));
+
+  for (i = 0, j = 0; i < ASIZE; i++) {
+    if (a[i]!= 0) {
+      setNode(&na[j], i, a[i], NOCHILD, NOCHILD);
+      j++;
+    }
+  }
+
+  return na;
+}
+
+int nodeComp(const void * a, const void * b)
+{
+  const node *n1 = (const node *)a;
+  const node *n2 = (const node *)b;
+
+  /* compared rather than subtracted, which could overflow an int */
+  if (n1->freq != n2->freq) {
+    return n1->freq < n2->freq ? -1 : 1;
+  }
+  /* ties are broken by char, so the tree doesn't depend on qsort */
+  return n1->c - n2->c;
+}
+
+int populateTree(tree *tr)
+{
+  /* Two-queue method: the leaves are already sorted at the start of
+  * tr->a, and each new parent is added after them.  A parent is never
+  * smaller than the one made before it, so the parents are sorted too,
+  * and the 2 smallest nodes are always at the front of one queue or the
+  * other.  After the initial qsort this is O(n), with no searching or
+  * moving of elements.  Every node ends up after its children, with
+  * the root last.
+  *
+  * See hufftest.c for testing.  For different tree-building methods, 
+  * (with a test case of 5000 nodes, starting from a sorted 
+  * initial state, no optimisation flags)
+  * representative results are:
+  * time spent to execute qsort: 0.810000s
+  * time spent to execute binary search + memmove: 0.010000s
+  * time spent to execute insertion sort: 0.170000s
+  * The two-queue method is faster again, and unlike binary search +
+  * memmove doesn't slow down quadratically as the tree grows.
+  */
+  int lchild, rchild, leaf = 0, head = tr->len, tail;
+  uint64_t newfreq;
+
+  for (tail = tr->len; tail < 2 * tr->len - 1; tail++) {
+    lchild = takeSmallest(tr, &leaf, &head, tail);
+    rchild = takeSmallest(tr, &leaf, &head, tail);
+    newfreq = tr->a[lchild].freq + tr->a[rchild].freq;
+    setNode(&tr->a[tail], PNODE, newfreq, lchild, rchild);
+  }
+  return tail - 1; /* returns position of root node */
+}
+
+int takeSmallest(tree *tr, int *leaf, int *head, int tail)
+{
+  /* removes the smaller of the 2 queue fronts, preferring leaves on a
+   * tie to keep the tree shallow */
+  if (*head == tail || (*leaf < tr->len 
+    && tr->a[*leaf].freq <= tr->a[*head].freq)) {
+    return (*leaf)++;
+  }
+  return (*head)++;
+}
+
+int treeHeight(tree *tr, int n)
+{
+  int lh, rh;
+  if (n == NOCHILD) {
+    return -1;
+  }
+
+  lh = treeHeight(tr, tr->a[n].left);
+  rh = treeHeight(tr, tr->a[n].right);
+
+  if (lh > rh) {
+    return lh + 1;
+  }
+  else {
+    return rh + 1;
+  }
+}
+
+void buildCodes(uint64_t *a, int maxcodelen, codeTable *t)
+{
+  /* canonical codes for the chars of a, from maxcodelen > 0 bits of
+   * package-merge, or from the populateTree() tree */
+  tree tr = {NULL, 0, 0};
+
+  if (maxcodelen != 0) {
+    packageMerge(a, maxcodelen, t);
+  }
+  else {
+    buildTree(a, &tr);
+    buildCodeTable(&tr, t);
+    limitCodeLengths(t, MAXCODELEN);
+    freeMem(tr.a);
+  }
+  assignCanonicalCodes(t);
+}
+
+void buildCodeTable(tree *tr, codeTable *t)
+{
+  memset(t, 0, sizeof(codeTable));
+  fillCodeTable(tr, tr->root, 0, 0, t);
+}
+
+void fillCodeTable(tree *tr, int n, uint64_t code, int len, codeTable *t)
+{
+  /* Each leaf's encoding is the path taken to reach it, so one pass
+   * over the tree gives every code, with no searching or reversing. */
+  if (tr->a[n].left == NOCHILD) {
+    if (len > ACCBITS - BITSPERBYTE) {
+      /* a code must fit in the accumulator alongside a partial byte */
+      huffError("tree too deep to encode");
+      fail();
+    }
+    t->code[tr->a[n].c] = code;
+    t->len[tr->a[n].c] = len;
+    return;
+  }
+  fillCodeTable(tr, tr->a[n].left, code << 1, len + 1, t);
+  fillCodeTable(tr, tr->a[n].right, (code << 1) | 1, len + 1, t);
+}
+
+void limitCodeLengths(codeTable *t, int maxlen)
+{
+  /* If the tree is too deep, the code length counts are adjusted in the
+   * same way as the JPEG standard (Annex K.3): a pair of the longest
+   * codes is replaced by one code a level up, and a shorter code is split
+   * into two to make room for its partner.  The new lengths are then
+   * handed out again, shortest first, in the order of the old lengths,
+   * so more frequent chars still get the shorter codes. */
+  int i, j, l, maxl = 0;
+  int count[ACCBITS + 1] = {0};
+
+  for (i = 0; i < ASIZE; i++) {
+    count[t->len[i]]++;
+    if (t->len[i] > maxl) {
+      maxl = t->len[i];
+    }
+  }
+  if (maxl <= maxlen) {
+    return;
+  }
+
+  for (l = maxl; l > maxlen; l--) {
+    while (count[l] > 0) {
+      for (j = l - 2; count[j] == 0; j--) {
+        ;
+      }
+      count[l] -= 2;
+      count[l - 1]++;
+      count[j + 1] += 2;
+      count[j]--;
+    }
+  }
+
+  for (l = 1, j = 1; l <= maxl; l++) {
+    for (i = 0; i < ASIZE; i++) {
+      if (t->len[i] == l) {
+        while (count[j] == 0) {
+          j++;
+        }
+        count[j]--;
+        t->len[i] = -j; /* negated to mark as done */
+      }
+    }
+  }
+  for (i = 0; i < ASIZE; i++) {
+    t->len[i] = -t->len[i];
+  }
+}
+
+void packageMerge(uint64_t *a, int maxlen, codeTable *t)
+{
+  /* Finds the optimal code lengths of at most maxlen bits.  Level 1 is
+   * the chars sorted by frequency.  Each level above merges the sorted
+   * chars with "packages" made by pairing off consecutive items of the
+   * level below.  Taking the 2n - 2 cheapest items of the top level,
+   * each char's code length is the number of levels it is taken from:
+   * the first m items of a level hold some number of chars and packages,
+   * and each package taken takes 2 more items from the level below. */
+  node *sorted;
+  uint64_t *w[MAXCODELEN + 1], pw;
+  char *isleaf[MAXCODELEN + 1];
+  int len[MAXCODELEN + 1];
+  int i, j, k, m, n, leaves;
+
+  n = calcNodeCnt(a);
+  if (n > 1 << maxlen) {
+    huffError("%d chars need codes longer than %d bits",
+      n, maxlen);
+    fail();
+  }
+  sorted = createNodeArray(a, n);
+  qsort(sorted, n, sizeof(node), nodeComp);
+
+  for (k = 1; k <= maxlen; k++) {
+    w[k] = (uint64_t *)allocMem(sizeof(uint64_t) * 2 * n);
+    isleaf[k] = (char *)allocMem(2 * n);
+  }
+
+  for (i = 0; i < n; i++) {
+    w[1][i] = sorted[i].freq;
+    isleaf[1][i] = 1;
+  }
+  len[1] = n;
+  for (k = 2; k <= maxlen; k++) {
+    for (i = j = m = 0; i < n || j + 1 < len[k - 1]; m++) {
+      pw = j + 1 < len[k - 1] ? w[k - 1][j] + w[k - 1][j + 1] : 0;
+      if (j + 1 >= len[k - 1] || (i < n && sorted[i].freq <= pw)) {
+        w[k][m] = sorted[i++].freq;
+        isleaf[k][m] = 1;
+      }
+      else {
+        w[k][m] = pw;
+        isleaf[k][m] = 0;
+        j += 2;
+      }
+    }
+    len[k] = m;
+  }
+
+  memset(t, 0, sizeof(codeTable));
+  m = 2 * n - 2;
+  for (k = maxlen; k >= 1 && m > 0; k--) {
+    for (i = leaves = 0; i < m; i++) {
+      leaves += isleaf[k][i];
+    }
+    for (i = 0; i < leaves; i++) {
+      t->len[sorted[i].c]++;
+    }
+    m = 2 * (m - leaves);
+  }
+
+  for (k = 1; k <= maxlen; k++) {
+    freeMem(w[k]);
+    freeMem(isleaf[k]);
+  }
+  freeMem(sorted);
+}
+
+void assignCanonicalCodes(codeTable *t)
+{
+  /* The first code of each length follows on from the last code of the
+   * length before, with a 0 appended. */
+  int i, l;
+  int count[MAXCODELEN + 1] = {0};
+  uint64_t next[MAXCODELEN + 1];
+
+  for (i = 0; i < ASIZE; i++) {
+    count[t->len[i]]++;
+  }
+  count[0] = 0;
+  next[0] = 0;
+  for (l = 1; l <= MAXCODELEN; l++) {
+    next[l] = (next[l - 1] + count[l - 1]) << 1;
+  }
+  for (i = 0; i < ASIZE; i++) {
+    if (t->len[i] != 0) {
+      t->code[i] = next[t->len[i]]++;
+    }
+  }
+}